@@ -48,6 +48,14 @@
  *	OCF_RESKEY_cidr_netmask=64
  *	OCF_RESKEY_nic=eth0
  *
+ * or, to manage many addresses at once:
+ *	OCF_RESKEY_ipv6addrs="3ffe:ffff:0:f101::3/64 3ffe:ffff:0:f101::4/64"
+ *
+ * Optionally, when the rtnetlink backend is available:
+ *	OCF_RESKEY_nodad=true
+ *	OCF_RESKEY_preferred_lft=forever
+ *	OCF_RESKEY_valid_lft=forever
+ *
  */
  
 /*
@@ -104,6 +112,13 @@
 #include <syslog.h>
 #include <signal.h>
 #include <errno.h>
+#include <strings.h>
+#ifdef HAVE_LINUX_RTNETLINK_H
+#include <linux/rtnetlink.h> /* for RTM_NEWADDR */
+#include <linux/if_addr.h> /* for IFA_F_NODAD */
+#else
+#define IFA_F_NODAD	0x02
+#endif
 #include <clplumbing/cl_log.h>
 
 
@@ -149,6 +164,11 @@ const char*	VALIDATE_CMD 	= "validate-all";
 
 const int	QUERY_COUNT	= 5;
 
+/* address flags and lifetimes, only honoured by the rtnetlink backend */
+static unsigned int	addr6_flags	= 0;
+static uint32_t		preferred_lft	= INFINITY_LIFE_TIME;
+static uint32_t		valid_lft	= INFINITY_LIFE_TIME;
+
 struct in6_ifreq {
 	struct in6_addr ifr6_addr;
 	uint32_t ifr6_prefixlen;
@@ -161,6 +181,23 @@ static int status_addr6(struct in6_addr* addr6, int prefix_len, char* prov_ifnam
 static int monitor_addr6(struct in6_addr* addr6, int prefix_len);
 static int advt_addr6(struct in6_addr* addr6, int prefix_len, char* prov_ifname);
 static int meta_data_addr6(void);
+static int parse_lifetime(const char* name, uint32_t* lft);
+
+static int batch_addr6(const char* self, const char* cmd, char* ipv6addrs,
+		       int prefix_len, char* prov_ifname);
+static int parse_addr6_list(char* list, int prefix_len,
+			    struct addr6_entry** entries);
+static void scan_if_batch(struct addr6_entry* entries, int count,
+			  int use_mask, char* prov_ifname);
+static int start_addr6_batch(struct addr6_entry* entries, int count,
+			     char* prov_ifname);
+static int stop_addr6_batch(struct addr6_entry* entries, int count,
+			    char* prov_ifname);
+static int status_addr6_batch(struct addr6_entry* entries, int count,
+			      char* prov_ifname);
+static int advt_addr6_batch(struct addr6_entry* entries, int count,
+			    char* prov_ifname);
+static void send_ua_batch(struct addr6_entry* entries, int count);
 
 
 static void usage(const char* self);
@@ -181,6 +218,7 @@ main(int argc, char* argv[])
 {
 	char		pid_file[256];
 	char*		ipv6addr;
+	char*		ipv6addrs;
 	char*		cidr_netmask;
 	int		ret;
 	char*		cp;
@@ -216,15 +254,19 @@ main(int argc, char* argv[])
 
 	/* check the OCF_RESKEY_ipv6addr parameter, should be an IPv6 address */
 	ipv6addr = getenv("OCF_RESKEY_ipv6addr");
+	ipv6addrs = getenv("OCF_RESKEY_ipv6addrs");
+	if (ipv6addrs != NULL && *ipv6addrs == 0) {
+		ipv6addrs = NULL;
+	}
 
-	if (ipv6addr == NULL) {
-		cl_log(LOG_ERR, "Please set OCF_RESKEY_ipv6addr to the IPv6 address you want to manage.");
+	if (ipv6addr == NULL && ipv6addrs == NULL) {
+		cl_log(LOG_ERR, "Please set OCF_RESKEY_ipv6addr (or OCF_RESKEY_ipv6addrs) to the IPv6 address(es) you want to manage.");
 		usage(argv[0]);
 		return OCF_ERR_ARGS;
 	}
 
 	/* legacy option */
-	if ((cp = strchr(ipv6addr, '/'))) {
+	if (ipv6addrs == NULL && (cp = strchr(ipv6addr, '/'))) {
 		prefix_len = atol(cp + 1);
 		if ((prefix_len < 0) || (prefix_len > 128)) {
 			cl_log(LOG_ERR, "Invalid prefix_len [%s], should be an integer in [0, 128]", cp+1);
@@ -257,7 +299,24 @@ main(int argc, char* argv[])
 	/* get provided interface name (optional) */
 	prov_ifname = getenv("OCF_RESKEY_nic");
 
-	if (inet_pton(AF_INET6, ipv6addr, &addr6) <= 0) {
+	/* address flags and lifetimes (optional) */
+	cp = getenv("OCF_RESKEY_nodad");
+	if (cp != NULL && (!strcasecmp(cp, "true") || !strcasecmp(cp, "yes")
+			   || !strcmp(cp, "1"))) {
+		addr6_flags |= IFA_F_NODAD;
+	}
+	if (parse_lifetime("OCF_RESKEY_preferred_lft", &preferred_lft) < 0
+	||  parse_lifetime("OCF_RESKEY_valid_lft", &valid_lft) < 0) {
+		usage(argv[0]);
+		return OCF_ERR_ARGS;
+	}
+	if (preferred_lft > valid_lft) {
+		cl_log(LOG_ERR, "preferred_lft must not exceed valid_lft");
+		usage(argv[0]);
+		return OCF_ERR_ARGS;
+	}
+
+	if (ipv6addrs == NULL && inet_pton(AF_INET6, ipv6addr, &addr6) <= 0) {
 		cl_log(LOG_ERR, "Invalid IPv6 address [%s]", ipv6addr);
 		usage(argv[0]);
 		return OCF_ERR_ARGS;
@@ -269,6 +328,12 @@ main(int argc, char* argv[])
 		return OCF_ERR_GENERIC;
 	}
 
+	/* many addresses at once */
+	if (ipv6addrs != NULL) {
+		return batch_addr6(argv[0], argv[1], ipv6addrs, prefix_len,
+				   prov_ifname);
+	}
+
 	/* create the pid file so we can make sure that only one IPv6addr
 	 * for this address is running
 	 */
@@ -422,9 +487,21 @@ scan_if(struct in6_addr* addr_target, int* plen_target, int use_mask, char* prov
 	FILE *f;
 	static char devname[21]="";
 	struct in6_addr addr;
-	struct in6_addr mask;
 	unsigned int plen, scope, dad_status, if_idx;
 	unsigned int addr6p[4];
+#ifdef HAVE_LINUX_RTNETLINK_H
+	int rc;
+
+	/* Prefer a single RTM_GETADDR dump over parsing /proc */
+	rc = nl_scan_addr6(addr_target, plen_target, use_mask,
+			   prov_ifname, devname);
+	if (rc == 0) {
+		return devname;
+	} else if (rc > 0) {
+		return NULL;
+	}
+	cl_log(LOG_DEBUG, "rtnetlink unavailable, scanning %s", IF_INET6);
+#endif
 
 	/* open /proc/net/if_inet6 file */
 	if ((f = fopen(IF_INET6, "r")) == NULL) {
@@ -434,9 +511,6 @@ scan_if(struct in6_addr* addr_target, int* plen_target, int use_mask, char* prov
 	/* Loop for each entry */
 	while (1) {
 		int		i;
-		int		n;
-		int		s;
-		gboolean	same = TRUE;
 
 		i = fscanf(f, "%08x%08x%08x%08x %x %02x %02x %02x %20s\n",
 		       	   &addr6p[0], &addr6p[1], &addr6p[2], &addr6p[3],
@@ -480,31 +554,8 @@ scan_if(struct in6_addr* addr_target, int* plen_target, int use_mask, char* prov
 			addr.s6_addr32[i] = htonl(addr6p[i]);
 		}
 
-		/* Make the mask based on prefix length */
-		memset(mask.s6_addr, 0xff, 16);
-		if (use_mask && plen < 128) {
-			n = plen / 32;
-			memset(mask.s6_addr32 + n + 1, 0, (3 - n) * 4);
-			s = 32 - plen % 32;
-			if (s == 32) 
-				mask.s6_addr32[n] = 0x0;
-			else
-				mask.s6_addr32[n] = 0xffffffff << s;
-			mask.s6_addr32[n] = htonl(mask.s6_addr32[n]);
-		}
-
-		/* compare addr and addr_target */
-		same = TRUE;
-		for (i = 0; i < 4; i++) {
-			if ((addr.s6_addr32[i]&mask.s6_addr32[i]) !=
-			    (addr_target->s6_addr32[i]&mask.s6_addr32[i])) {
-				same = FALSE;
-				break;
-			}
-		}
-		
 		/* We found it!	*/
-		if (same) {
+		if (addr6_prefix_match(&addr, addr_target, plen, use_mask)) {
 			fclose(f);
 			*plen_target = plen;
 			return devname;
@@ -541,6 +592,19 @@ assign_addr6(struct in6_addr* addr6, int prefix_len, char* if_name)
 	/* Get socket first */
 	int		fd;
 	struct ifreq	ifr;
+#ifdef HAVE_LINUX_RTNETLINK_H
+	int		rc;
+
+	rc = nl_assign_addr6(addr6, prefix_len, if_name,
+			     addr6_flags, preferred_lft, valid_lft);
+	if (rc == 0) {
+		return 0;
+	} else if (rc != EPROTONOSUPPORT && rc != EAFNOSUPPORT) {
+		cl_log(LOG_ERR, "RTM_NEWADDR on %s failed: %s",
+		       if_name, strerror(rc));
+		return -1;
+	}
+#endif
 
 	fd = socket(AF_INET6, SOCK_DGRAM, 0);
 	if (fd < 0) {
@@ -569,6 +633,18 @@ unassign_addr6(struct in6_addr* addr6, int prefix_len, char* if_name)
 	int			fd;
 	struct ifreq		ifr;
 	struct in6_ifreq	ifr6;
+#ifdef HAVE_LINUX_RTNETLINK_H
+	int			rc;
+
+	rc = nl_unassign_addr6(addr6, prefix_len, if_name);
+	if (rc == 0) {
+		return 0;
+	} else if (rc != EPROTONOSUPPORT && rc != EAFNOSUPPORT) {
+		cl_log(LOG_ERR, "RTM_DELADDR on %s failed: %s",
+		       if_name, strerror(rc));
+		return -1;
+	}
+#endif
 
 	/* Get socket first */
 	fd = socket(AF_INET6, SOCK_DGRAM, 0);
@@ -631,6 +707,7 @@ is_addr6_available(struct in6_addr* addr6)
 			   (struct sockaddr *) &addr,
 			   sizeof(struct sockaddr_in6));
 	if (0 >= ret) {
+		close(icmp_sock);
 		return -1;
 	}
 
@@ -645,6 +722,7 @@ is_addr6_available(struct in6_addr* addr6)
 	msg.msg_controllen = 0;
 
 	ret = recvmsg(icmp_sock, &msg, MSG_DONTWAIT);
+	close(icmp_sock);
 	if (0 >= ret) {
 		return -1;
 	}
@@ -652,6 +730,387 @@ is_addr6_available(struct in6_addr* addr6)
 	return 0;
 }
 
+/* Batch mode: OCF_RESKEY_ipv6addrs holds a list of addresses which
+ * are looked up with one address dump, added or removed with one
+ * netlink batch, and advertised together.
+ */
+static int
+batch_addr6(const char* self, const char* cmd, char* ipv6addrs,
+	    int prefix_len, char* prov_ifname)
+{
+	char			pid_file[256];
+	char			first[INET6_ADDRSTRLEN];
+	struct addr6_entry*	entries = NULL;
+	int			count;
+	int			ret;
+
+	count = parse_addr6_list(ipv6addrs, prefix_len, &entries);
+	if (count <= 0) {
+		usage(self);
+		return OCF_ERR_ARGS;
+	}
+
+	inet_ntop(AF_INET6, &entries[0].addr, first, sizeof(first));
+	if (snprintf(pid_file, sizeof(pid_file), "%s%s.batch",
+		     PIDFILE_BASE, first) >= (int)sizeof(pid_file)) {
+		cl_log(LOG_ERR, "Pid file truncated");
+		free(entries);
+		return OCF_ERR_GENERIC;
+	}
+	if (write_pid_file(pid_file) < 0) {
+		free(entries);
+		return OCF_ERR_GENERIC;
+	}
+
+	if (0 == strncmp(START_CMD, cmd, strlen(START_CMD))) {
+		ret = start_addr6_batch(entries, count, prov_ifname);
+	}else if (0 == strncmp(STOP_CMD, cmd, strlen(STOP_CMD))) {
+		ret = stop_addr6_batch(entries, count, prov_ifname);
+	}else if (0 == strncmp(STATUS_CMD, cmd, strlen(STATUS_CMD))
+	||	  0 == strncmp(MONITOR_CMD, cmd, strlen(MONITOR_CMD))) {
+		ret = status_addr6_batch(entries, count, prov_ifname);
+	}else if (0 == strncmp(RELOAD_CMD, cmd, strlen(RELOAD_CMD))
+	||	  0 == strncmp(RECOVER_CMD, cmd, strlen(RECOVER_CMD))) {
+		ret = OCF_ERR_UNIMPLEMENTED;
+	}else if (0 == strncmp(VALIDATE_CMD, cmd, strlen(VALIDATE_CMD))) {
+		ret = OCF_SUCCESS;
+	}else if (0 == strncmp(ADVT_CMD, cmd, strlen(ADVT_CMD))) {
+		ret = advt_addr6_batch(entries, count, prov_ifname);
+	}else{
+		usage(self);
+		ret = OCF_ERR_ARGS;
+	}
+
+	unlink(pid_file);
+	free(entries);
+	return ret;
+}
+
+/* Parse a whitespace or comma separated list of address[/prefix] */
+static int
+parse_addr6_list(char* list, int prefix_len, struct addr6_entry** entries)
+{
+	const char*		sep = " \t\n,";
+	char*			tok;
+	char*			saveptr = NULL;
+	char*			cp;
+	int			count = 0;
+	int			size = 16;
+	struct addr6_entry*	e;
+
+	*entries = calloc(size, sizeof(struct addr6_entry));
+	if (*entries == NULL) {
+		cl_log(LOG_ERR, "Memory allocation failure: %s", strerror(errno));
+		return -1;
+	}
+
+	for (tok = strtok_r(list, sep, &saveptr); tok != NULL;
+	     tok = strtok_r(NULL, sep, &saveptr)) {
+		if (count == size) {
+			size *= 2;
+			e = realloc(*entries, size * sizeof(struct addr6_entry));
+			if (e == NULL) {
+				cl_log(LOG_ERR, "Memory allocation failure: %s",
+				       strerror(errno));
+				free(*entries);
+				*entries = NULL;
+				return -1;
+			}
+			*entries = e;
+		}
+		e = &(*entries)[count];
+		memset(e, 0, sizeof(*e));
+		e->prefix_len = prefix_len;
+
+		if ((cp = strchr(tok, '/'))) {
+			e->prefix_len = atol(cp + 1);
+			if (e->prefix_len < 0 || e->prefix_len > 128) {
+				cl_log(LOG_ERR, "Invalid prefix_len [%s], "
+				       "should be an integer in [0, 128]", cp+1);
+				free(*entries);
+				*entries = NULL;
+				return -1;
+			}
+			*cp = 0;
+		}
+		if (inet_pton(AF_INET6, tok, &e->addr) <= 0) {
+			cl_log(LOG_ERR, "Invalid IPv6 address [%s]", tok);
+			free(*entries);
+			*entries = NULL;
+			return -1;
+		}
+		count++;
+	}
+
+	if (count == 0) {
+		cl_log(LOG_ERR, "OCF_RESKEY_ipv6addrs contains no address");
+		free(*entries);
+		*entries = NULL;
+	}
+	return count;
+}
+
+/* find the interfaces of all entries, with one dump if possible */
+static void
+scan_if_batch(struct addr6_entry* entries, int count, int use_mask,
+	      char* prov_ifname)
+{
+	int	i;
+	int	plen;
+	char*	if_name;
+
+#ifdef HAVE_LINUX_RTNETLINK_H
+	if (nl_scan_addr6_batch(entries, count, use_mask, prov_ifname) == 0) {
+		return;
+	}
+	cl_log(LOG_DEBUG, "rtnetlink unavailable, scanning %s", IF_INET6);
+#endif
+	for (i = 0; i < count; i++) {
+		plen = entries[i].prefix_len;
+		if_name = scan_if(&entries[i].addr, &plen, use_mask,
+				  prov_ifname);
+		entries[i].found = (if_name != NULL);
+		entries[i].status = 0;
+		if (if_name != NULL) {
+			strncpy(entries[i].ifname, if_name,
+				sizeof(entries[i].ifname) - 1);
+			entries[i].prefix_len = plen;
+		}
+	}
+}
+
+static int
+start_addr6_batch(struct addr6_entry* entries, int count, char* prov_ifname)
+{
+	struct addr6_entry*	todo;
+	int			ntodo = 0;
+	int			pending;
+	int			ret = OCF_SUCCESS;
+	int			i;
+	int			j;
+	char			buf[INET6_ADDRSTRLEN];
+
+	todo = calloc(count, sizeof(struct addr6_entry));
+	if (todo == NULL) {
+		cl_log(LOG_ERR, "Memory allocation failure: %s", strerror(errno));
+		return OCF_ERR_GENERIC;
+	}
+
+	/* skip the addresses which are already there */
+	scan_if_batch(entries, count, 0, prov_ifname);
+	for (i = 0; i < count; i++) {
+		if (!entries[i].found) {
+			todo[ntodo] = entries[i];
+			todo[ntodo].ifname[0] = 0;
+			ntodo++;
+		}
+	}
+	if (ntodo == 0) {
+		free(todo);
+		return OCF_SUCCESS;
+	}
+
+	/* we need to find a proper device for each remaining address */
+	scan_if_batch(todo, ntodo, 1, prov_ifname);
+	for (i = 0; i < ntodo; i++) {
+		if (todo[i].found) {
+			continue;
+		}
+		inet_ntop(AF_INET6, &todo[i].addr, buf, sizeof(buf));
+		if (prov_ifname != 0 && *prov_ifname != 0
+		&&  todo[i].prefix_len != 0) {
+			strncpy(todo[i].ifname, prov_ifname,
+				sizeof(todo[i].ifname) - 1);
+			continue;
+		}
+		cl_log(LOG_ERR, "no valid mechanisms for %s", buf);
+		free(todo);
+		return OCF_ERR_GENERIC;
+	}
+
+	/* Assign the addresses */
+#ifdef HAVE_LINUX_RTNETLINK_H
+	if (nl_modify_addr6_batch(RTM_NEWADDR, todo, ntodo, addr6_flags,
+				  preferred_lft, valid_lft) < 0)
+#endif
+	{
+		for (i = 0; i < ntodo; i++) {
+			todo[i].status = assign_addr6(&todo[i].addr,
+						      todo[i].prefix_len,
+						      todo[i].ifname) ? EIO : 0;
+		}
+	}
+	for (i = 0; i < ntodo; i++) {
+		if (todo[i].status == 0 || todo[i].status == EEXIST) {
+			todo[i].found = 1;
+			continue;
+		}
+		todo[i].found = 0;
+		inet_ntop(AF_INET6, &todo[i].addr, buf, sizeof(buf));
+		cl_log(LOG_ERR, "failed to assign %s to %s: %s", buf,
+		       todo[i].ifname, strerror(todo[i].status));
+		ret = OCF_ERR_GENERIC;
+	}
+
+	/* Check whether the addresses are available */
+	for (i = 0; i < QUERY_COUNT; i++) {
+		pending = 0;
+		for (j = 0; j < ntodo; j++) {
+			if (todo[j].found == 1) {
+				if (0 == is_addr6_available(&todo[j].addr)) {
+					todo[j].found = 2;
+				} else {
+					pending++;
+				}
+			}
+		}
+		if (pending == 0) {
+			break;
+		}
+		sleep(1);
+	}
+	for (j = 0; j < ntodo; j++) {
+		if (todo[j].found == 1) {
+			inet_ntop(AF_INET6, &todo[j].addr, buf, sizeof(buf));
+			cl_log(LOG_ERR, "failed to ping the address %s", buf);
+			ret = OCF_ERR_GENERIC;
+		}
+	}
+
+	/* Send unsolicited advertisement packets to neighbor */
+	for (j = 0; j < ntodo; j++) {
+		todo[j].found = (todo[j].found == 2);
+	}
+	send_ua_batch(todo, ntodo);
+
+	free(todo);
+	return ret;
+}
+
+static int
+stop_addr6_batch(struct addr6_entry* entries, int count, char* prov_ifname)
+{
+	int	i;
+	int	ret = OCF_SUCCESS;
+	char	buf[INET6_ADDRSTRLEN];
+
+	scan_if_batch(entries, count, 0, prov_ifname);
+	for (i = 0; i < count; i++) {
+		if (!entries[i].found) {
+			entries[i].ifname[0] = 0;
+		}
+	}
+
+	/* Unassign the addresses */
+#ifdef HAVE_LINUX_RTNETLINK_H
+	if (nl_modify_addr6_batch(RTM_DELADDR, entries, count, 0,
+				  INFINITY_LIFE_TIME, INFINITY_LIFE_TIME) < 0)
+#endif
+	{
+		for (i = 0; i < count; i++) {
+			if (!entries[i].found) {
+				continue;
+			}
+			entries[i].status =
+				unassign_addr6(&entries[i].addr,
+					       entries[i].prefix_len,
+					       entries[i].ifname) ? EIO : 0;
+		}
+	}
+	for (i = 0; i < count; i++) {
+		if (!entries[i].found || entries[i].status == 0
+		||  entries[i].status == EADDRNOTAVAIL) {
+			continue;
+		}
+		inet_ntop(AF_INET6, &entries[i].addr, buf, sizeof(buf));
+		cl_log(LOG_ERR, "failed to remove %s from %s: %s", buf,
+		       entries[i].ifname, strerror(entries[i].status));
+		ret = OCF_ERR_GENERIC;
+	}
+	return ret;
+}
+
+/* status and monitor: all addresses are checked against one dump */
+static int
+status_addr6_batch(struct addr6_entry* entries, int count, char* prov_ifname)
+{
+	int	i;
+	int	present = 0;
+	char	buf[INET6_ADDRSTRLEN];
+
+	scan_if_batch(entries, count, 0, prov_ifname);
+	for (i = 0; i < count; i++) {
+		if (entries[i].found && entries[i].status == 0) {
+			present++;
+		}
+	}
+	if (present == count) {
+		return OCF_SUCCESS;
+	}
+	if (present == 0) {
+		return OCF_NOT_RUNNING;
+	}
+	for (i = 0; i < count; i++) {
+		if (entries[i].found && entries[i].status == 0) {
+			continue;
+		}
+		inet_ntop(AF_INET6, &entries[i].addr, buf, sizeof(buf));
+		cl_log(LOG_ERR, "%s is %s", buf, entries[i].found
+		       ? "a duplicate (DAD failed)" : "missing");
+	}
+	return OCF_ERR_GENERIC;
+}
+
+static int
+advt_addr6_batch(struct addr6_entry* entries, int count, char* prov_ifname)
+{
+	scan_if_batch(entries, count, 0, prov_ifname);
+	send_ua_batch(entries, count);
+	return OCF_SUCCESS;
+}
+
+/* Send the unsolicited advertisements for all found entries in rounds,
+ * so the whole batch takes UA_REPEAT_COUNT seconds rather than that
+ * much per address.
+ */
+static void
+send_ua_batch(struct addr6_entry* entries, int count)
+{
+	int	i;
+	int	j;
+
+	for (i = 0; i < UA_REPEAT_COUNT; i++) {
+		for (j = 0; j < count; j++) {
+			if (entries[j].found) {
+				send_ua(&entries[j].addr, entries[j].ifname);
+			}
+		}
+		sleep(1);
+	}
+}
+
+/* parse a lifetime in seconds; "forever" or unset means infinite */
+static int
+parse_lifetime(const char* name, uint32_t* lft)
+{
+	char*		val = getenv(name);
+	char*		endp = NULL;
+	unsigned long	secs;
+
+	if (val == NULL || *val == 0 || !strcmp(val, "forever")) {
+		*lft = INFINITY_LIFE_TIME;
+		return 0;
+	}
+	errno = 0;
+	secs = strtoul(val, &endp, 10);
+	if (errno || endp == val || *endp != 0 || secs > INFINITY_LIFE_TIME) {
+		cl_log(LOG_ERR, "Invalid lifetime in %s [%s]", name, val);
+		return -1;
+	}
+	*lft = (uint32_t)secs;
+	return 0;
+}
+
 static void usage(const char* self)
 {
 	printf("usage: %s {start|stop|status|monitor|validate-all|meta-data}\n",self);
@@ -843,13 +1302,27 @@ meta_data_addr6(void)
 	"  </longdesc>\n"
 	"  <shortdesc lang=\"en\">Manages IPv6 aliases</shortdesc>\n"
 	"  <parameters>\n"
-	"    <parameter name=\"ipv6addr\" unique=\"0\" required=\"1\">\n"
+	"    <parameter name=\"ipv6addr\" unique=\"0\" required=\"0\">\n"
 	"      <longdesc lang=\"en\">\n"
-	"	The IPv6 address this RA will manage \n"
+	"	The IPv6 address this RA will manage. Required unless\n"
+	"	ipv6addrs is set.\n"
 	"      </longdesc>\n"
 	"      <shortdesc lang=\"en\">IPv6 address</shortdesc>\n"
 	"      <content type=\"string\" default=\"\" />\n"
 	"    </parameter>\n"
+	"    <parameter name=\"ipv6addrs\" unique=\"0\">\n"
+	"      <longdesc lang=\"en\">\n"
+	"	A list of IPv6 addresses, each optionally with a /prefix,\n"
+	"	separated by spaces or commas. When set, ipv6addr is ignored\n"
+	"	and all addresses are added, removed and monitored together:\n"
+	"	they are looked up with one address dump, changed in one\n"
+	"	netlink batch and advertised in parallel. monitor only checks\n"
+	"	that the addresses are configured and fails if some of them\n"
+	"	are missing.\n"
+	"      </longdesc>\n"
+	"      <shortdesc lang=\"en\">List of IPv6 addresses</shortdesc>\n"
+	"      <content type=\"string\" default=\"\" />\n"
+	"    </parameter>\n"
 	"    <parameter name=\"cidr_netmask\" unique=\"0\">\n"
 	"      <longdesc lang=\"en\">\n"
 	"	The netmask for the interface in CIDR format. (ie, 24).\n"
@@ -867,6 +1340,30 @@ meta_data_addr6(void)
 	"      <shortdesc lang=\"en\">Network interface</shortdesc>\n"
 	"      <content type=\"string\" default=\"\" />\n"
 	"    </parameter>\n"
+	"    <parameter name=\"nodad\" unique=\"0\">\n"
+	"      <longdesc lang=\"en\">\n"
+	"	Skip Duplicate Address Detection when adding the address,\n"
+	"	so it can be used right away.\n"
+	"      </longdesc>\n"
+	"      <shortdesc lang=\"en\">Disable DAD</shortdesc>\n"
+	"      <content type=\"boolean\" default=\"false\" />\n"
+	"    </parameter>\n"
+	"    <parameter name=\"preferred_lft\" unique=\"0\">\n"
+	"      <longdesc lang=\"en\">\n"
+	"	Preferred lifetime of the address in seconds, or \"forever\".\n"
+	"	Set it to 0 to add a deprecated address that is not used as\n"
+	"	a source for new connections.\n"
+	"      </longdesc>\n"
+	"      <shortdesc lang=\"en\">Preferred lifetime</shortdesc>\n"
+	"      <content type=\"string\" default=\"forever\" />\n"
+	"    </parameter>\n"
+	"    <parameter name=\"valid_lft\" unique=\"0\">\n"
+	"      <longdesc lang=\"en\">\n"
+	"	Valid lifetime of the address in seconds, or \"forever\".\n"
+	"      </longdesc>\n"
+	"      <shortdesc lang=\"en\">Valid lifetime</shortdesc>\n"
+	"      <content type=\"string\" default=\"forever\" />\n"
+	"    </parameter>\n"
 	"  </parameters>\n"
 	"  <actions>\n"
 	"    <action name=\"start\"   timeout=\"15s\" />\n"
@@ -0,0 +1,516 @@
+/*
+ * rtnetlink backend for the IPv6addr resource agent.
+ *
+ * Addresses are added and removed with RTM_NEWADDR/RTM_DELADDR, and
+ * looked up with a single RTM_GETADDR dump instead of parsing
+ * /proc/net/if_inet6 line by line. Requests for many addresses are
+ * packed into as few datagrams as possible.
+ *
+ * This library is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This library is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+ */
+
+#include <config.h>
+#include <IPv6addr.h>
+
+#ifdef HAVE_LINUX_RTNETLINK_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include <net/if.h> /* for if_nametoindex */
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_addr.h>
+
+#ifndef NETLINK_GET_STRICT_CHK
+#define NETLINK_GET_STRICT_CHK	12
+#endif
+
+#define NL_RECV_BUFSIZE	32768
+#define NL_BATCH_BUFSIZE	32768
+/* each request is acknowledged separately; keep the acks of one
+ * datagram well within the receive buffer */
+#define NL_BATCH_MAX		128
+#define NL_RCVBUF		(1024 * 1024)
+
+struct nl_addr6_req {
+	struct nlmsghdr		n;
+	struct ifaddrmsg	ifa;
+	char			buf[128];
+};
+
+static int nl_addattr(void *msg, size_t maxlen, int type,
+		      const void *data, size_t alen);
+static int nl_build_addr6(char* buf, size_t maxlen, int cmd, uint32_t seq,
+			  const struct in6_addr* addr6, int prefix_len,
+			  unsigned int ifindex, unsigned int flags,
+			  uint32_t preferred_lft, uint32_t valid_lft);
+static int nl_flush_batch(int fd, char* buf, size_t len,
+			  struct addr6_entry* entries, int first, int last);
+static int nl_modify_addr6(int cmd, struct in6_addr* addr6, int prefix_len,
+			   const char* if_name, unsigned int flags,
+			   uint32_t preferred_lft, uint32_t valid_lft);
+
+int
+nl_open(void)
+{
+	int			fd;
+	struct sockaddr_nl	snl;
+
+	fd = socket(AF_NETLINK, SOCK_RAW|SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (fd < 0) {
+		return -1;
+	}
+
+	memset(&snl, 0, sizeof(snl));
+	snl.nl_family = AF_NETLINK;
+	if (bind(fd, (struct sockaddr *)&snl, sizeof(snl)) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/* msg is the whole request buffer of maxlen bytes, starting with the
+ * nlmsghdr */
+static int
+nl_addattr(void *msg, size_t maxlen, int type,
+	   const void *data, size_t alen)
+{
+	struct nlmsghdr*	n = msg;
+	size_t		len = RTA_LENGTH(alen);
+	struct rtattr*	rta;
+
+	if (NLMSG_ALIGN(n->nlmsg_len) + RTA_ALIGN(len) > maxlen) {
+		return -1;
+	}
+	rta = (struct rtattr *)(void *)((char *)n + NLMSG_ALIGN(n->nlmsg_len));
+	rta->rta_type = type;
+	rta->rta_len = len;
+	if (alen) {
+		memcpy(RTA_DATA(rta), data, alen);
+	}
+	n->nlmsg_len = NLMSG_ALIGN(n->nlmsg_len) + RTA_ALIGN(len);
+	return 0;
+}
+
+/* Append an address request to buf; returns its length or -1 */
+static int
+nl_build_addr6(char* buf, size_t maxlen, int cmd, uint32_t seq,
+	       const struct in6_addr* addr6, int prefix_len,
+	       unsigned int ifindex, unsigned int flags,
+	       uint32_t preferred_lft, uint32_t valid_lft)
+{
+	struct nl_addr6_req*	req = (struct nl_addr6_req *)(void *)buf;
+	struct ifa_cacheinfo	ci;
+
+	if (maxlen < sizeof(*req)) {
+		return -1;
+	}
+	memset(req, 0, sizeof(*req));
+	req->n.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+	req->n.nlmsg_type = cmd;
+	req->n.nlmsg_flags = NLM_F_REQUEST|NLM_F_ACK;
+	if (cmd == RTM_NEWADDR) {
+		req->n.nlmsg_flags |= NLM_F_CREATE|NLM_F_EXCL;
+	}
+	req->n.nlmsg_seq = seq;
+	req->ifa.ifa_family = AF_INET6;
+	req->ifa.ifa_prefixlen = prefix_len;
+	req->ifa.ifa_flags = flags & 0xff;
+	req->ifa.ifa_index = ifindex;
+
+	if (nl_addattr(req, sizeof(*req), IFA_LOCAL, addr6,
+		       sizeof(*addr6)) < 0
+	||  nl_addattr(req, sizeof(*req), IFA_ADDRESS, addr6,
+		       sizeof(*addr6)) < 0) {
+		return -1;
+	}
+
+	if (cmd == RTM_NEWADDR && (preferred_lft != INFINITY_LIFE_TIME
+				   || valid_lft != INFINITY_LIFE_TIME)) {
+		memset(&ci, 0, sizeof(ci));
+		ci.ifa_prefered = preferred_lft;
+		ci.ifa_valid = valid_lft;
+		if (nl_addattr(req, sizeof(*req), IFA_CACHEINFO, &ci,
+			       sizeof(ci)) < 0) {
+			return -1;
+		}
+	}
+	return NLMSG_ALIGN(req->n.nlmsg_len);
+}
+
+/* Send the requests for entries [first, last) in one datagram and
+ * collect one acknowledgement per request into entry->status. Only
+ * entries marked EINPROGRESS have a request in the datagram; any that
+ * are left unacknowledged keep that status and count as failed.
+ */
+static int
+nl_flush_batch(int fd, char* buf, size_t len,
+	       struct addr6_entry* entries, int first, int last)
+{
+	struct sockaddr_nl	nladdr;
+	char			rbuf[NL_RECV_BUFSIZE];
+	struct nlmsghdr*	h;
+	struct nlmsgerr*	err;
+	ssize_t			rlen;
+	int			pending = 0;
+	int			i;
+
+	for (i = first; i < last; i++) {
+		if (entries[i].status == EINPROGRESS) {
+			pending++;
+		}
+	}
+
+	memset(&nladdr, 0, sizeof(nladdr));
+	nladdr.nl_family = AF_NETLINK;
+	if (sendto(fd, buf, len, 0,
+		   (struct sockaddr *)&nladdr, sizeof(nladdr)) < 0) {
+		for (i = first; i < last; i++) {
+			if (entries[i].status == EINPROGRESS) {
+				entries[i].status = errno;
+			}
+		}
+		return -1;
+	}
+
+	while (pending > 0) {
+		rlen = recv(fd, rbuf, sizeof(rbuf), 0);
+		if (rlen < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			/* acks were lost; the outcome is unknown */
+			for (i = first; i < last; i++) {
+				if (entries[i].status == EINPROGRESS) {
+					entries[i].status = errno;
+				}
+			}
+			return -1;
+		}
+		for (h = (struct nlmsghdr *)(void *)rbuf; NLMSG_OK(h, rlen);
+		     h = NLMSG_NEXT(h, rlen)) {
+			if (h->nlmsg_type != NLMSG_ERROR) {
+				continue;
+			}
+			/* sequence numbers are entry index + 1 */
+			i = (int)h->nlmsg_seq - 1;
+			if (i < first || i >= last
+			||  entries[i].status != EINPROGRESS) {
+				continue;
+			}
+			err = (struct nlmsgerr *)NLMSG_DATA(h);
+			entries[i].status = -err->error;
+			pending--;
+		}
+	}
+	return 0;
+}
+
+/* Add (RTM_NEWADDR) or remove (RTM_DELADDR) all entries whose ifname
+ * is set, packing as many requests as fit into each sendto().
+ *
+ * Per-entry results are left in entry->status (0 or errno). Returns
+ * the number of failed entries, or -1 if netlink is not usable.
+ */
+int
+nl_modify_addr6_batch(int cmd, struct addr6_entry* entries, int count,
+		      unsigned int flags,
+		      uint32_t preferred_lft, uint32_t valid_lft)
+{
+	int		fd;
+	char*		buf;
+	size_t		len = 0;
+	int		first = 0;
+	int		failed = 0;
+	int		i;
+	int		n;
+	int		nmsg = 0;
+	int		rcvbuf = NL_RCVBUF;
+	unsigned int	ifindex;
+
+	if ((fd = nl_open()) < 0) {
+		return -1;
+	}
+	if (setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE,
+		       &rcvbuf, sizeof(rcvbuf)) < 0) {
+		setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+	}
+	if ((buf = malloc(NL_BATCH_BUFSIZE)) == NULL) {
+		close(fd);
+		return -1;
+	}
+
+	for (i = 0; i < count; i++) {
+		entries[i].status = 0;
+		if (entries[i].ifname[0] == 0) {
+			entries[i].status = ENODEV;
+			continue;
+		}
+		ifindex = if_nametoindex(entries[i].ifname);
+		if (ifindex == 0) {
+			entries[i].status = ENODEV;
+			continue;
+		}
+		n = -1;
+		if (nmsg < NL_BATCH_MAX) {
+			n = nl_build_addr6(buf + len, NL_BATCH_BUFSIZE - len,
+					   cmd, i + 1, &entries[i].addr,
+					   entries[i].prefix_len, ifindex,
+					   flags, preferred_lft, valid_lft);
+		}
+		if (n < 0) {
+			/* datagram full, send what we have and retry */
+			nl_flush_batch(fd, buf, len, entries, first, i);
+			len = 0;
+			nmsg = 0;
+			first = i;
+			i--;
+			continue;
+		}
+		if (len == 0) {
+			first = i;
+		}
+		entries[i].status = EINPROGRESS;
+		nmsg++;
+		len += n;
+	}
+	if (len > 0) {
+		nl_flush_batch(fd, buf, len, entries, first, count);
+	}
+
+	free(buf);
+	close(fd);
+
+	for (i = 0; i < count; i++) {
+		if (entries[i].status) {
+			failed++;
+		}
+	}
+	return failed;
+}
+
+static int
+nl_modify_addr6(int cmd, struct in6_addr* addr6, int prefix_len,
+		const char* if_name, unsigned int flags,
+		uint32_t preferred_lft, uint32_t valid_lft)
+{
+	struct addr6_entry	entry;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.addr = *addr6;
+	entry.prefix_len = prefix_len;
+	strncpy(entry.ifname, if_name, sizeof(entry.ifname) - 1);
+
+	if (nl_modify_addr6_batch(cmd, &entry, 1, flags,
+				  preferred_lft, valid_lft) < 0) {
+		return entry.status ? entry.status : EPROTONOSUPPORT;
+	}
+	return entry.status;
+}
+
+int
+nl_assign_addr6(struct in6_addr* addr6, int prefix_len, const char* if_name,
+		unsigned int flags, uint32_t preferred_lft, uint32_t valid_lft)
+{
+	return nl_modify_addr6(RTM_NEWADDR, addr6, prefix_len, if_name,
+			       flags, preferred_lft, valid_lft);
+}
+
+int
+nl_unassign_addr6(struct in6_addr* addr6, int prefix_len, const char* if_name)
+{
+	return nl_modify_addr6(RTM_DELADDR, addr6, prefix_len, if_name,
+			       0, INFINITY_LIFE_TIME, INFINITY_LIFE_TIME);
+}
+
+/* Match every entry against one RTM_GETADDR dump.
+ *
+ * The semantics follow scan_if(): global addresses are always
+ * considered, link-local ones only when prov_ifname is set. When
+ * prov_ifname is set the kernel filters the dump to that interface.
+ * An entry with a non-zero prefix_len only matches addresses with
+ * that prefix length; on a match entry->found, entry->ifname and
+ * entry->prefix_len are filled in, and entry->status is set to
+ * EADDRNOTAVAIL if DAD failed for the address.
+ *
+ * Returns 0, or -1 if netlink could not be used at all.
+ */
+int
+nl_scan_addr6_batch(struct addr6_entry* entries, int count, int use_mask,
+		    const char* prov_ifname)
+{
+	int			fd;
+	int			one = 1;
+	int			done = 0;
+	int			i;
+	unsigned int		ifindex = 0;
+	struct sockaddr_nl	nladdr;
+	char			buf[NL_RECV_BUFSIZE];
+	struct {
+		struct nlmsghdr		n;
+		struct ifaddrmsg	ifa;
+	} req;
+	struct nlmsghdr*	h;
+	ssize_t			len;
+
+	for (i = 0; i < count; i++) {
+		entries[i].found = 0;
+	}
+	if (prov_ifname && *prov_ifname) {
+		ifindex = if_nametoindex(prov_ifname);
+		if (ifindex == 0) {
+			return 0;
+		}
+	}
+
+	if ((fd = nl_open()) < 0) {
+		return -1;
+	}
+	if (ifindex) {
+		/* Ask the kernel to only dump the provided interface;
+		 * older kernels ignore this, so we keep filtering below.
+		 */
+		setsockopt(fd, SOL_NETLINK, NETLINK_GET_STRICT_CHK,
+			   &one, sizeof(one));
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.n.nlmsg_len = NLMSG_LENGTH(sizeof(struct ifaddrmsg));
+	req.n.nlmsg_type = RTM_GETADDR;
+	req.n.nlmsg_flags = NLM_F_REQUEST|NLM_F_DUMP;
+	req.n.nlmsg_seq = 1;
+	req.ifa.ifa_family = AF_INET6;
+	req.ifa.ifa_index = ifindex;
+
+	memset(&nladdr, 0, sizeof(nladdr));
+	nladdr.nl_family = AF_NETLINK;
+	if (sendto(fd, &req, req.n.nlmsg_len, 0,
+		   (struct sockaddr *)&nladdr, sizeof(nladdr)) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	while (!done) {
+		len = recv(fd, buf, sizeof(buf), 0);
+		if (len < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			close(fd);
+			return -1;
+		}
+		for (h = (struct nlmsghdr *)(void *)buf; NLMSG_OK(h, len);
+		     h = NLMSG_NEXT(h, len)) {
+			struct ifaddrmsg*	ifa;
+			struct rtattr*		rta;
+			struct in6_addr*	addr = NULL;
+			int			alen;
+
+			if (h->nlmsg_type == NLMSG_DONE) {
+				done = 1;
+				break;
+			}
+			if (h->nlmsg_type == NLMSG_ERROR) {
+				close(fd);
+				return -1;
+			}
+			if (h->nlmsg_type != RTM_NEWADDR) {
+				continue;
+			}
+
+			ifa = (struct ifaddrmsg *)NLMSG_DATA(h);
+			if (ifa->ifa_family != AF_INET6) {
+				continue;
+			}
+			if (ifindex && ifa->ifa_index != ifindex) {
+				continue;
+			}
+			/* Same scope rules as the /proc/net/if_inet6 scan */
+			if (ifa->ifa_scope != RT_SCOPE_UNIVERSE) {
+				if (ifa->ifa_scope != RT_SCOPE_LINK || !ifindex) {
+					continue;
+				}
+			}
+
+			alen = IFA_PAYLOAD(h);
+			for (rta = IFA_RTA(ifa); RTA_OK(rta, alen);
+			     rta = RTA_NEXT(rta, alen)) {
+				if (rta->rta_type == IFA_ADDRESS) {
+					addr = (struct in6_addr *)RTA_DATA(rta);
+				}
+			}
+			if (addr == NULL) {
+				continue;
+			}
+
+			for (i = 0; i < count; i++) {
+				struct addr6_entry* e = &entries[i];
+
+				if (e->found) {
+					continue;
+				}
+				if (e->prefix_len != 0
+				&&  ifa->ifa_prefixlen != e->prefix_len) {
+					continue;
+				}
+				if (!addr6_prefix_match(addr, &e->addr,
+							ifa->ifa_prefixlen,
+							use_mask)) {
+					continue;
+				}
+				if (if_indextoname(ifa->ifa_index,
+						   e->ifname) == NULL) {
+					continue;
+				}
+				e->prefix_len = ifa->ifa_prefixlen;
+				e->status = (ifa->ifa_flags & IFA_F_DADFAILED)
+					? EADDRNOTAVAIL : 0;
+				e->found = 1;
+			}
+		}
+	}
+
+	close(fd);
+	return 0;
+}
+
+int
+nl_scan_addr6(struct in6_addr* addr_target, int* plen_target, int use_mask,
+	      const char* prov_ifname, char* devname)
+{
+	struct addr6_entry	entry;
+
+	memset(&entry, 0, sizeof(entry));
+	entry.addr = *addr_target;
+	entry.prefix_len = *plen_target;
+	if (nl_scan_addr6_batch(&entry, 1, use_mask, prov_ifname) < 0) {
+		return -1;
+	}
+	if (!entry.found) {
+		return 1;
+	}
+	strcpy(devname, entry.ifname);
+	*plen_target = entry.prefix_len;
+	return 0;
+}
+
+#endif /* HAVE_LINUX_RTNETLINK_H */
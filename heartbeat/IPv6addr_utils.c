@@ -145,3 +145,39 @@ err:
 	free(payload);
 	return status;
 }
+
+/* Compare two addresses, either fully or only on the first plen bits.
+ * Returns non-zero when they match.
+ */
+int
+addr6_prefix_match(const struct in6_addr* addr,
+		   const struct in6_addr* addr_target,
+		   unsigned int plen, int use_mask)
+{
+	struct in6_addr	mask;
+	int		i;
+	int		n;
+	int		s;
+
+	/* Make the mask based on prefix length */
+	memset(mask.s6_addr, 0xff, 16);
+	if (use_mask && plen < 128) {
+		n = plen / 32;
+		memset(mask.s6_addr32 + n + 1, 0, (3 - n) * 4);
+		s = 32 - plen % 32;
+		if (s == 32)
+			mask.s6_addr32[n] = 0x0;
+		else
+			mask.s6_addr32[n] = 0xffffffff << s;
+		mask.s6_addr32[n] = htonl(mask.s6_addr32[n]);
+	}
+
+	/* compare addr and addr_target */
+	for (i = 0; i < 4; i++) {
+		if ((addr->s6_addr32[i]&mask.s6_addr32[i]) !=
+		    (addr_target->s6_addr32[i]&mask.s6_addr32[i])) {
+			return 0;
+		}
+	}
+	return 1;
+}
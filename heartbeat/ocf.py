@@ -18,7 +18,7 @@
 # Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 # 
 
-import sys, os, logging, syslog
+import sys, os, logging, syslog, time
 
 argv=sys.argv
 env=os.environ
@@ -98,6 +98,71 @@ HA_LOGFACILITY = env.get("HA_LOGFACILITY")
 HA_LOGFILE = env.get("HA_LOGFILE")
 HA_DEBUGLOG = env.get("HA_DEBUGLOG")
 
+
+## Metadata cache. run() keeps the XML it prints for meta-data in
+## OCF_PY_CACHE (a directory, HA_RSCTMP by default, "no" to turn the
+## cache off) with the agent, this file and the environment as key, and
+## it is served from there as soon as the agent imports this module,
+## before whatever else the agent imports and sets up.
+
+def _meta_cache():
+	"""
+	Return the cache file and key for the agent, or None.
+	"""
+	import zlib
+	d = env.get("OCF_PY_CACHE", env.get("HA_RSCTMP", "/run/resource-agents"))
+	if not d.startswith("/"):
+		return None
+	try:
+		agent = os.path.realpath(argv[0])
+		key = []
+		for fn in (agent, os.path.realpath(__file__)):
+			st = os.stat(fn)
+			key.append("{}:{}:{}".format(fn, st.st_mtime, st.st_size))
+		envs = "\0".join("{}={}".format(k, v) for k, v in sorted(env.items())
+						 if not k.startswith("OCF_RESKEY_CRM_meta_"))
+		key.append("{:08x}".format(zlib.crc32(envs.encode("utf-8")) & 0xffffffff))
+	except Exception:
+		return None
+	return os.path.join(d, ".ocf_py_meta." + os.path.basename(agent)), " ".join(key)
+
+
+def _meta_cached():
+	cache = _meta_cache()
+	if cache is None:
+		return None
+	try:
+		with open(cache[0]) as f:
+			if f.readline().rstrip("\n") == cache[1]:
+				return f.read()
+	except (IOError, OSError):
+		pass
+	return None
+
+
+def _meta_save(xml):
+	cache = _meta_cache()
+	if cache is None:
+		return
+	tmp = "{}.{}".format(cache[0], os.getpid())
+	try:
+		with open(tmp, "w") as f:
+			f.write(cache[1] + "\n" + xml)
+		os.rename(tmp, cache[0])
+	except (IOError, OSError):
+		try:
+			os.unlink(tmp)
+		except OSError:
+			pass
+
+
+if OCF_ACTION == "meta-data":
+	_xml = _meta_cached()
+	if _xml is not None:
+		sys.stdout.write(_xml)
+		sys.stdout.flush()
+		sys.exit(OCF_SUCCESS)
+
 log = logging.getLogger(os.path.basename(argv[0]))
 log.setLevel(logging.DEBUG)
 
@@ -140,6 +205,99 @@ if HA_DEBUGLOG and HA_LOGFILE != HA_DEBUGLOG:
 logger = logging.LoggerAdapter(log, {'OCF_RESOURCE_INSTANCE': OCF_RESOURCE_INSTANCE})
 
 
+def _last_pid():
+	try:
+		with open("/proc/loadavg") as f:
+			return int(f.read().split()[4])
+	except Exception:
+		return None
+
+
+class _Stats(object):
+	"""
+	Statistics of the action, written as a JSON line at exit
+	like those of ocf-shellfuncs (see OCF_TRACE_STATS there).
+	Commands are those run with the subprocess module.
+	"""
+	def __init__(self, dest):
+		self.dest = dest
+		self.t0 = time.time()
+		self.pid0 = _last_pid()
+		self.rc = None
+		self.cmds = {}
+		self.order = []
+
+	def add(self, name, secs):
+		if name not in self.cmds:
+			self.cmds[name] = [0, 0.0]
+			self.order.append(name)
+		self.cmds[name][0] += 1
+		self.cmds[name][1] += secs
+
+	def write(self):
+		import json
+		t = os.times()
+		pid1 = _last_pid()
+		pids = None
+		if self.pid0 is not None and pid1 is not None and pid1 >= self.pid0:
+			pids = pid1 - self.pid0
+		rc = self.rc
+		if rc is not None and not isinstance(rc, int):
+			rc = OCF_ERR_GENERIC
+		line = '{{"ts":{:.3f},"agent":{},"rsc":{},"action":{},"interval":{},' \
+			'"rc":{},"ms":{:.3f},"cpu_ms":{:.3f},"pids":{},"cmds":{{{}}}}}\n'.format(
+			self.t0, json.dumps(os.path.basename(argv[0])),
+			json.dumps(OCF_RESOURCE_INSTANCE or "default"),
+			json.dumps(OCF_ACTION or ""),
+			int(env.get("OCF_RESKEY_CRM_meta_interval") or 0),
+			json.dumps(rc), (time.time() - self.t0) * 1000,
+			(t[0] + t[1] + t[2] + t[3]) * 1000, json.dumps(pids),
+			",".join('{}:{{"n":{},"ms":{:.3f}}}'.format(json.dumps(name),
+				self.cmds[name][0], self.cmds[name][1] * 1000)
+				for name in self.order))
+		try:
+			d = os.path.dirname(self.dest)
+			if not os.path.isdir(d):
+				os.makedirs(d)
+			with open(self.dest, "a") as f:
+				f.write(line)
+		except (IOError, OSError):
+			pass
+
+
+def _trace_subprocess(stats):
+	import subprocess
+	Popen = subprocess.Popen
+
+	class TracedPopen(Popen):
+		def __init__(self, args, *a, **kw):
+			self._ocf_t0 = time.time()
+			if isinstance(args, (list, tuple)):
+				self._ocf_name = os.path.basename(str(args[0]))
+			else:
+				self._ocf_name = os.path.basename(str(args).split(" ")[0])
+			self._ocf_done = False
+			Popen.__init__(self, args, *a, **kw)
+
+		def _ocf_record(self):
+			if not self._ocf_done and self.returncode is not None:
+				self._ocf_done = True
+				stats.add(self._ocf_name, time.time() - self._ocf_t0)
+
+		def wait(self, *a, **kw):
+			rc = Popen.wait(self, *a, **kw)
+			self._ocf_record()
+			return rc
+
+		def poll(self, *a, **kw):
+			rc = Popen.poll(self, *a, **kw)
+			self._ocf_record()
+			return rc
+
+	subprocess.Popen = TracedPopen
+
+
+
 _exit_reason_set = False
 
 def ocf_exit_reason(msg):
@@ -235,6 +393,18 @@ def distro():
 	return platform.system()
 
 
+_stats = None
+OCF_TRACE_STATS = env.get("OCF_TRACE_STATS", get_parameter("trace_stats", ""))
+if OCF_TRACE_STATS.startswith("/") or is_true(OCF_TRACE_STATS):
+	import atexit
+	if not OCF_TRACE_STATS.startswith("/"):
+		OCF_TRACE_STATS = os.path.join(env.get("HA_VARLIB", "/var/lib/heartbeat"),
+									   "trace_ra", "stats.jsonl")
+	_stats = _Stats(OCF_TRACE_STATS)
+	_trace_subprocess(_stats)
+	atexit.register(_stats.write)
+
+
 class Parameter(object):
 	def __init__(self, name, shortdesc, longdesc, content_type, unique, required, default):
 		self.name = name
@@ -312,18 +482,22 @@ class Agent(object):
 		self.parameters = []
 		self.actions = []
 		self._handlers = {}
+		self._params = {}
+		self._xml = None
 
 	def add_parameter(self, name, shortdesc="", longdesc="", content_type="string", unique=False, required=False, default=None):
-		for param in self.parameters:
-			if param.name == name:
-				raise ValueError("Parameter {} defined twice in metadata".format(name))
-		self.parameters.append(Parameter(name=name,
-										 shortdesc=shortdesc,
-										 longdesc=longdesc,
-										 content_type=content_type,
-										 unique=unique,
-										 required=required,
-										 default=default))
+		if name in self._params:
+			raise ValueError("Parameter {} defined twice in metadata".format(name))
+		param = Parameter(name=name,
+						  shortdesc=shortdesc,
+						  longdesc=longdesc,
+						  content_type=content_type,
+						  unique=unique,
+						  required=required,
+						  default=default)
+		self.parameters.append(param)
+		self._params[name] = param
+		self._xml = None
 		return self
 
 	def add_action(self, name, timeout=None, interval=None, depth=None, role=None, handler=None):
@@ -332,6 +506,7 @@ class Agent(object):
 								   interval=interval,
 								   depth=depth,
 								   role=role))
+		self._xml = None
 		if handler is not None:
 			self._handlers[name] = handler
 		return self
@@ -340,6 +515,11 @@ class Agent(object):
 		return self.to_xml()
 
 	def to_xml(self):
+		if self._xml is None:
+			self._xml = self._render_xml()
+		return self._xml
+
+	def _render_xml(self):
 		return """<?xml version="1.0"?>
 <!DOCTYPE resource-agent SYSTEM "ra-api-1.dtd">
 <resource-agent name="{name}">
@@ -383,8 +563,36 @@ def run(agent, handlers=None):
 	the run loop will read parameter values from the
 	environment and pass to the handler.
 	"""
+	try:
+		_run(agent, handlers)
+	except SystemExit as err:
+		if _stats is not None:
+			_stats.rc = err.code
+		raise
+
+
+def _handler_params(func):
+	"""
+	Names of the arguments of a handler, without importing
+	inspect (which is slow to load) for plain functions and
+	methods.
+	"""
+	code = getattr(func, "__code__", None)
+	if code is not None and not code.co_flags & 0x0c:
+		names = list(code.co_varnames[:code.co_argcount +
+									  getattr(code, "co_kwonlyargcount", 0)])
+		if getattr(func, "__self__", None) is not None:
+			names = names[1:]
+		return names
 	import inspect
+	if hasattr(inspect, 'signature'):
+		return list(inspect.signature(func).parameters.keys())
+	params = inspect.getargspec(func).args
+	if 'self' in params: params.remove('self')
+	return params
+
 
+def _run(agent, handlers):
 	agent._handlers.update(handlers or {})
 	handlers = agent._handlers
 
@@ -395,18 +603,13 @@ def run(agent, handlers=None):
 				sys.exit(OCF_ERR_CONFIGURED)
 
 	def call_handler(func):
-		if hasattr(inspect, 'signature'):
-			params = inspect.signature(func).parameters.keys()
-		else:
-			params = inspect.getargspec(func).args
-			if 'self' in params: params.remove('self')
+		params = _handler_params(func)
 		def value_for_parameter(param):
 			val = get_parameter(param)
 			if val is not None:
 				return val
-			for p in agent.parameters:
-				if p.name == param:
-					return p.default
+			if param in agent._params:
+				return agent._params[param].default
 		arglist = [value_for_parameter(p) for p in params]
 		try:
 			rc = func(*arglist)
@@ -437,7 +640,10 @@ def run(agent, handlers=None):
 		ocf_exit_reason("No action argument set")
 		sys.exit(OCF_ERR_UNIMPLEMENTED)
 	if OCF_ACTION in ('meta-data', 'usage', 'methods'):
-		sys.stdout.write(agent.to_xml() + "\n")
+		xml = agent.to_xml() + "\n"
+		sys.stdout.write(xml)
+		if OCF_ACTION == "meta-data":
+			_meta_save(xml)
 		sys.exit(OCF_SUCCESS)
 
 	check_required_params()
@@ -22,6 +22,7 @@
 #ifndef OCF_IPV6_HELPER_H
 #define OCF_IPV6_HELPER_H
 #include <netinet/icmp6.h>
+#include <net/if.h>
 #include <config.h>
 /*
 0	No error, action succeeded completely
@@ -53,6 +54,34 @@
 #define UA_REPEAT_COUNT	5
 #define  BCAST_ADDR "ff02::1"
 #define IF_INET6 "/proc/net/if_inet6"
+#define INFINITY_LIFE_TIME	0xFFFFFFFFU
+
+/* one address of a batch, see the ipv6addrs parameter */
+struct addr6_entry {
+	struct in6_addr	addr;
+	int		prefix_len;
+	char		ifname[IF_NAMESIZE];
+	int		found;
+	int		status;	/* 0 or errno of the last operation */
+};
 
 int send_ua(struct in6_addr* src_ip, char* if_name);
+int addr6_prefix_match(const struct in6_addr* addr,
+		       const struct in6_addr* addr_target,
+		       unsigned int plen, int use_mask);
+
+#ifdef HAVE_LINUX_RTNETLINK_H
+/* rtnetlink backend, see IPv6addr_netlink.c */
+int nl_open(void);
+int nl_assign_addr6(struct in6_addr* addr6, int prefix_len, const char* if_name,
+		    unsigned int flags, uint32_t preferred_lft, uint32_t valid_lft);
+int nl_unassign_addr6(struct in6_addr* addr6, int prefix_len, const char* if_name);
+int nl_scan_addr6(struct in6_addr* addr_target, int* plen_target, int use_mask,
+		  const char* prov_ifname, char* devname);
+int nl_modify_addr6_batch(int cmd, struct addr6_entry* entries, int count,
+			  unsigned int flags,
+			  uint32_t preferred_lft, uint32_t valid_lft);
+int nl_scan_addr6_batch(struct addr6_entry* entries, int count, int use_mask,
+			const char* prov_ifname);
+#endif
 #endif
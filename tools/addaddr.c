@@ -0,0 +1,379 @@
+/*
+ * addaddr.c:	Adds or deletes IP addresses in one rtnetlink batch
+ *
+ *	The counterpart of findaddr for starting and stopping IPaddr2
+ *	resources with extra_ips: instead of running "ip addr add" (and
+ *	"ip link set up") for every address, all the RTM_NEWADDR or
+ *	RTM_DELADDR requests are put in one buffer and sent at once, and
+ *	the acknowledgements are collected afterwards.
+ *
+ *	usage: addaddr [-d] [-n] [-b brd] [-l label] [-f preferred_lft]
+ *			dev ip/prefix...
+ *
+ *	-d	delete the addresses instead of adding them
+ *	-n	noprefixroute
+ *	-b	IPv4 broadcast: an address, or "+"/"-" as for "ip addr"
+ *	-l	IPv4 label
+ *	-f	IPv6 preferred lifetime, in seconds or "forever"
+ *
+ *	An address which is already there (already gone with -d) is no
+ *	error. Each address that could not be added or deleted is reported
+ *	on stderr; the exit code is then 1, and 2 on other errors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_addr.h>
+
+#define ADDADDR_BUFSIZE		65536
+/* requests per send, so that the acks always fit the receive buffer */
+#define ADDADDR_BATCH		128
+#define ADDADDR_MSGSIZE		256
+
+#ifndef IFA_F_NOPREFIXROUTE
+#define IFA_F_NOPREFIXROUTE	0x200
+#endif
+#ifndef INFINITY_LIFE_TIME
+#define INFINITY_LIFE_TIME	0xFFFFFFFFU
+#endif
+
+struct addr {
+	const char *arg;
+	int family;
+	unsigned char addr[16];
+	unsigned prefix;
+	int error;
+};
+
+struct options {
+	int del;
+	int noprefixroute;
+	const char *brd;
+	const char *label;
+	unsigned preferred_lft;
+	int ifindex;
+};
+
+static int parse_addr(struct addr *a, const char *arg);
+static void add_attr(struct nlmsghdr *h, int type, const void *data, int len);
+static int broadcast(const struct addr *a, const char *brd, struct in_addr *out);
+static int addr_msg(char *buf, const struct addr *a, const struct options *o,
+		    unsigned seq);
+static int link_up_msg(char *buf, int ifindex, unsigned seq);
+static int run_batch(int fd, char *buf, struct addr *as, int na,
+		     const struct options *o, int link_up);
+static void usage(void);
+
+static int parse_addr(struct addr *a, const char *arg)
+{
+	char ip[INET6_ADDRSTRLEN];
+	const char *c;
+	char *end;
+
+	memset(a, 0, sizeof(*a));
+	a->arg = arg;
+	c = strchr(arg, '/');
+	if (!c || c == arg || (size_t)(c - arg) >= sizeof(ip))
+		return -1;
+	memcpy(ip, arg, c - arg);
+	ip[c - arg] = 0;
+	c++;
+	a->prefix = strtoul(c, &end, 10);
+	if (end == c || *end)
+		return -1;
+
+	if (inet_pton(AF_INET, ip, a->addr) == 1) {
+		a->family = AF_INET;
+		if (a->prefix > 32)
+			return -1;
+	} else if (inet_pton(AF_INET6, ip, a->addr) == 1) {
+		a->family = AF_INET6;
+		if (a->prefix > 128)
+			return -1;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+static void add_attr(struct nlmsghdr *h, int type, const void *data, int len)
+{
+	struct rtattr *rta;
+
+	rta = (struct rtattr *)((char *)h + NLMSG_ALIGN(h->nlmsg_len));
+	rta->rta_type = type;
+	rta->rta_len = RTA_LENGTH(len);
+	memcpy(RTA_DATA(rta), data, len);
+	h->nlmsg_len = NLMSG_ALIGN(h->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+/* as "ip addr add ... brd {+|-|address}" */
+static int broadcast(const struct addr *a, const char *brd, struct in_addr *out)
+{
+	uint32_t mask, ip;
+
+	if (strcmp(brd, "+") && strcmp(brd, "-"))
+		return inet_pton(AF_INET, brd, out) == 1 ? 0 : -1;
+
+	mask = a->prefix ? htonl(~0U << (32 - a->prefix)) : 0;
+	memcpy(&ip, a->addr, 4);
+	out->s_addr = (*brd == '+') ? (ip | ~mask) : (ip & mask);
+	return 0;
+}
+
+static int addr_msg(char *buf, const struct addr *a, const struct options *o,
+		    unsigned seq)
+{
+	struct nlmsghdr *h = (struct nlmsghdr *)buf;
+	struct ifaddrmsg *ifa;
+	struct ifa_cacheinfo ci;
+	struct in_addr brd;
+	uint32_t flags;
+	int alen = (a->family == AF_INET) ? 4 : 16;
+
+	memset(buf, 0, ADDADDR_MSGSIZE);
+	h->nlmsg_len = NLMSG_LENGTH(sizeof(*ifa));
+	h->nlmsg_type = o->del ? RTM_DELADDR : RTM_NEWADDR;
+	h->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	if (!o->del)
+		h->nlmsg_flags |= NLM_F_CREATE | NLM_F_EXCL;
+	h->nlmsg_seq = seq;
+	ifa = NLMSG_DATA(h);
+	ifa->ifa_family = a->family;
+	ifa->ifa_prefixlen = a->prefix;
+	ifa->ifa_index = o->ifindex;
+
+	add_attr(h, IFA_LOCAL, a->addr, alen);
+	add_attr(h, IFA_ADDRESS, a->addr, alen);
+	if (o->del)
+		return h->nlmsg_len;
+
+	if (a->family == AF_INET) {
+		if (o->brd) {
+			if (broadcast(a, o->brd, &brd) < 0)
+				return -1;
+			add_attr(h, IFA_BROADCAST, &brd, 4);
+		}
+		if (o->label)
+			add_attr(h, IFA_LABEL, o->label, strlen(o->label) + 1);
+	} else if (o->preferred_lft != INFINITY_LIFE_TIME) {
+		memset(&ci, 0, sizeof(ci));
+		ci.ifa_prefered = o->preferred_lft;
+		ci.ifa_valid = INFINITY_LIFE_TIME;
+		add_attr(h, IFA_CACHEINFO, &ci, sizeof(ci));
+	}
+	if (o->noprefixroute) {
+		flags = IFA_F_NOPREFIXROUTE;
+		add_attr(h, IFA_FLAGS, &flags, sizeof(flags));
+	}
+	return h->nlmsg_len;
+}
+
+static int link_up_msg(char *buf, int ifindex, unsigned seq)
+{
+	struct nlmsghdr *h = (struct nlmsghdr *)buf;
+	struct ifinfomsg *ifi;
+
+	memset(buf, 0, ADDADDR_MSGSIZE);
+	h->nlmsg_len = NLMSG_LENGTH(sizeof(*ifi));
+	h->nlmsg_type = RTM_NEWLINK;
+	h->nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK;
+	h->nlmsg_seq = seq;
+	ifi = NLMSG_DATA(h);
+	ifi->ifi_family = AF_UNSPEC;
+	ifi->ifi_index = ifindex;
+	ifi->ifi_flags = IFF_UP;
+	ifi->ifi_change = IFF_UP;
+	return h->nlmsg_len;
+}
+
+/*
+ * Send the requests for as[0..na) in one buffer (behind the link up
+ * request, if asked for) and wait for all their acks. The sequence
+ * number of each address request is its index + 1, the link request
+ * has 0.
+ */
+static int run_batch(int fd, char *buf, struct addr *as, int na,
+		     const struct options *o, int link_up)
+{
+	char *msgs, *p;
+	struct nlmsghdr *h;
+	struct nlmsgerr *err;
+	ssize_t len;
+	int pending, i, n;
+
+	msgs = malloc((size_t)(na + 1) * ADDADDR_MSGSIZE);
+	if (!msgs) {
+		fprintf(stderr, "Failed malloc()\n");
+		return -1;
+	}
+	p = msgs;
+	if (link_up)
+		p += NLMSG_ALIGN(link_up_msg(p, o->ifindex, 0));
+	for (i = 0; i < na; i++) {
+		n = addr_msg(p, &as[i], o, i + 1);
+		if (n < 0) {
+			fprintf(stderr, "Bad broadcast address %s\n", o->brd);
+			free(msgs);
+			return -1;
+		}
+		p += NLMSG_ALIGN(n);
+	}
+	if (send(fd, msgs, p - msgs, 0) < 0) {
+		fprintf(stderr, "Failed to send netlink request (%s)\n",
+			strerror(errno));
+		free(msgs);
+		return -1;
+	}
+	free(msgs);
+
+	pending = na + (link_up ? 1 : 0);
+	while (pending > 0) {
+		len = recv(fd, buf, ADDADDR_BUFSIZE, 0);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "Failed to read rtnetlink (%s)\n",
+				strerror(errno));
+			return -1;
+		}
+		for (h = (struct nlmsghdr *)buf; NLMSG_OK(h, len);
+		     h = NLMSG_NEXT(h, len)) {
+			if (h->nlmsg_type != NLMSG_ERROR || h->nlmsg_seq > (unsigned)na)
+				continue;
+			err = NLMSG_DATA(h);
+			pending--;
+			if (h->nlmsg_seq == 0) {
+				if (err->error)
+					fprintf(stderr, "Failed to set link up (%s)\n",
+						strerror(-err->error));
+				continue;
+			}
+			as[h->nlmsg_seq - 1].error = -err->error;
+		}
+	}
+	return 0;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: addaddr [-d] [-n] [-b brd] [-l label] [-f preferred_lft] dev ip/prefix...\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	struct options o;
+	struct addr *as;
+	char *buf, *end;
+	int na, i, done, failed, fd, ch;
+	int one = 1;
+
+	memset(&o, 0, sizeof(o));
+	o.preferred_lft = INFINITY_LIFE_TIME;
+	while ((ch = getopt(argc, argv, "dnb:l:f:")) != EOF) {
+		switch (ch) {
+		case 'd':
+			o.del = 1;
+			break;
+		case 'n':
+			o.noprefixroute = 1;
+			break;
+		case 'b':
+			o.brd = optarg;
+			break;
+		case 'l':
+			o.label = optarg;
+			if (strlen(o.label) >= IFNAMSIZ)
+				usage();
+			break;
+		case 'f':
+			if (strcmp(optarg, "forever") == 0)
+				break;
+			o.preferred_lft = strtoul(optarg, &end, 10);
+			if (end == optarg || *end)
+				usage();
+			break;
+		default:
+			usage();
+		}
+	}
+	if (argc - optind < 2)
+		usage();
+
+	o.ifindex = if_nametoindex(argv[optind]);
+	if (!o.ifindex) {
+		fprintf(stderr, "Device %s not available\n", argv[optind]);
+		return 2;
+	}
+	na = argc - optind - 1;
+	as = calloc(na, sizeof(*as));
+	buf = malloc(ADDADDR_BUFSIZE);
+	if (!as || !buf) {
+		fprintf(stderr, "Failed malloc()\n");
+		return 2;
+	}
+	for (i = 0; i < na; i++) {
+		if (parse_addr(&as[i], argv[optind + 1 + i]) < 0) {
+			fprintf(stderr, "Bad address %s\n", argv[optind + 1 + i]);
+			return 2;
+		}
+	}
+
+	fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open rtnetlink (%s)\n", strerror(errno));
+		return 2;
+	}
+#ifdef NETLINK_CAP_ACK
+	/* acks for failed requests need not carry the request back */
+	setsockopt(fd, SOL_NETLINK, NETLINK_CAP_ACK, &one, sizeof(one));
+#endif
+	(void)one;
+
+	for (done = 0; done < na; done += i) {
+		i = (na - done < ADDADDR_BATCH) ? na - done : ADDADDR_BATCH;
+		if (run_batch(fd, buf, as + done, i, &o, !o.del && done == 0) < 0)
+			return 2;
+	}
+	close(fd);
+
+	failed = 0;
+	for (i = 0; i < na; i++) {
+		if (!as[i].error)
+			continue;
+		if (!o.del && as[i].error == EEXIST)
+			continue;
+		if (o.del && (as[i].error == EADDRNOTAVAIL || as[i].error == ENOENT))
+			continue;
+		fprintf(stderr, "Failed to %s %s (%s)\n", o.del ? "delete" : "add",
+			as[i].arg, strerror(as[i].error));
+		failed = 1;
+	}
+	return failed;
+}
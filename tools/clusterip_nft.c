@@ -0,0 +1,625 @@
+/*
+   nftables backend for the Cluster IP mode of IPaddr2
+
+   Does what the iptables CLUSTERIP target does, with plain nf_tables
+   expressions. Every node holds the cluster address, and answers ARP
+   for it with the same multicast MAC address, so that every node
+   receives every packet for it. Each node hashes the source address
+   (and ports, depending on the hash mode) of incoming packets to a
+   bucket 1..total and drops the packets of the buckets it does not
+   serve. Each clone instance is one bucket.
+
+   For ip 192.168.1.10 there are two tables named ipaddr2_cip_192_168_1_10,
+   equivalent to:
+
+	table ip ipaddr2_cip_192_168_1_10 {
+		set buckets { type mark; }
+		chain prerouting {
+			type filter hook prerouting priority 0;
+			iifname nic ip daddr ip jhash ip saddr [. th sport
+			    [. th dport]] mod total seed 0 offset 1
+			    != @buckets drop
+			iifname nic ip daddr ip meta pkttype set host
+		}
+	}
+	table arp ipaddr2_cip_192_168_1_10 {
+		chain output {
+			type filter hook output priority 0;
+			oifname nic arp htype 1 arp hlen 6 arp plen 4
+			    arp saddr ip ip arp saddr ether set mac
+		}
+	}
+
+   The hash has a fixed seed, as all nodes must agree on the buckets.
+   The packet type can only be set before routing, so this is done in
+   prerouting, where CLUSTERIP works in INPUT.
+   Starting or stopping an instance is adding or removing one set
+   element; the tables are created with the first bucket and removed
+   with the last, each in one transaction.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/ioctl.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/if_packet.h>
+#include <linux/netfilter_arp.h>
+
+#include "nft_batch.h"
+
+/* exit codes */
+#define CIP_OK		0
+#define CIP_MORE	1	/* stop: other buckets are still served */
+#define CIP_ERROR	2
+
+#define CIP_SET		"buckets"
+#define CIP_SET_ID	1
+
+struct cip {
+	char table[64];
+	const char *nic;
+	struct in_addr ip;
+	unsigned char mac[6];
+	uint32_t total;
+	uint32_t bucket;
+	uint32_t hashlen;	/* bytes of address and ports to hash */
+};
+
+static void add_table(struct nft_buf *b, int family, const char *name,
+		      int flags);
+static int del_table(int fd, struct nft_buf *b, int family, const char *name);
+static void add_chain(struct nft_buf *b, int family, const char *table,
+		      const char *name, int hook);
+static void expr_ifname(struct nft_buf *b, uint32_t key, const char *nic);
+static void expr_hash(struct nft_buf *b, const struct cip *c, uint32_t reg);
+static void add_prerouting_rules(struct nft_buf *b, const struct cip *c);
+static void add_arp_rule(struct nft_buf *b, const struct cip *c);
+static void add_bucket(struct nft_buf *b, int type, int flags,
+		       const struct cip *c);
+static int set_multicast(const struct cip *c, int add);
+static struct nlattr *nla_data(const struct nlattr *a);
+static struct nlattr *nla_next(const struct nlattr *a);
+static int count_attrs(const struct nlattr *a, int len, int type);
+static int count_buckets(int fd, const struct cip *c);
+static int cip_start(int fd, const struct cip *c);
+static int cip_stop(int fd, const struct cip *c);
+static const char *cip_status(int fd, const struct cip *c);
+static int parse_args(char **argv, struct cip *c);
+static void usage(void);
+
+static void add_table(struct nft_buf *b, int family, const char *name,
+		      int flags)
+{
+	size_t m;
+
+	m = nft_msg_begin(b, NFT_MSG(NFT_MSG_NEWTABLE), family,
+			  flags | NLM_F_ACK);
+	nft_attr_put_str(b, NFTA_TABLE_NAME, name);
+	nft_attr_put_u32(b, NFTA_TABLE_FLAGS, 0);
+	nft_msg_end(b, m);
+}
+
+/* a table which is not there is no error */
+static int del_table(int fd, struct nft_buf *b, int family, const char *name)
+{
+	size_t m;
+	int ret;
+
+	nft_batch_begin(b);
+	m = nft_msg_begin(b, NFT_MSG(NFT_MSG_DELTABLE), family, NLM_F_ACK);
+	nft_attr_put_str(b, NFTA_TABLE_NAME, name);
+	nft_msg_end(b, m);
+	nft_batch_end(b);
+	ret = nft_talk(fd, b);
+	return (ret == -ENOENT) ? 0 : ret;
+}
+
+static void add_chain(struct nft_buf *b, int family, const char *table,
+		      const char *name, int hook)
+{
+	size_t m, h;
+
+	m = nft_msg_begin(b, NFT_MSG(NFT_MSG_NEWCHAIN), family,
+			  NLM_F_CREATE | NLM_F_ACK);
+	nft_attr_put_str(b, NFTA_CHAIN_TABLE, table);
+	nft_attr_put_str(b, NFTA_CHAIN_NAME, name);
+	h = nft_nest_begin(b, NFTA_CHAIN_HOOK);
+	nft_attr_put_u32(b, NFTA_HOOK_HOOKNUM, hook);
+	nft_attr_put_u32(b, NFTA_HOOK_PRIORITY, 0);
+	nft_nest_end(b, h);
+	nft_attr_put_u32(b, NFTA_CHAIN_POLICY, NF_ACCEPT);
+	nft_attr_put_str(b, NFTA_CHAIN_TYPE, "filter");
+	nft_msg_end(b, m);
+}
+
+/* interface names are compared on all IFNAMSIZ bytes */
+static void expr_ifname(struct nft_buf *b, uint32_t key, const char *nic)
+{
+	char name[IFNAMSIZ];
+
+	memset(name, 0, sizeof(name));
+	strncpy(name, nic, sizeof(name) - 1);
+	nft_expr_meta(b, key, NFT_REG_1);
+	nft_expr_cmp_eq(b, NFT_REG_1, name, sizeof(name));
+}
+
+/*
+ * The address and ports are loaded into consecutive 32 bit registers,
+ * the ports zero padded, and the hash of all of them replaces the
+ * first one.
+ */
+static void expr_hash(struct nft_buf *b, const struct cip *c, uint32_t reg)
+{
+	struct nft_expr e;
+
+	nft_expr_payload(b, NFT_PAYLOAD_NETWORK_HEADER, 12, 4, reg);
+	if (c->hashlen > 4)
+		nft_expr_payload(b, NFT_PAYLOAD_TRANSPORT_HEADER, 0, 2, reg + 1);
+	if (c->hashlen > 8)
+		nft_expr_payload(b, NFT_PAYLOAD_TRANSPORT_HEADER, 2, 2, reg + 2);
+
+	nft_expr_begin(b, &e, "hash");
+	nft_attr_put_u32(b, NFTA_HASH_SREG, reg);
+	nft_attr_put_u32(b, NFTA_HASH_DREG, reg);
+	nft_attr_put_u32(b, NFTA_HASH_LEN, c->hashlen);
+	nft_attr_put_u32(b, NFTA_HASH_MODULUS, c->total);
+	nft_attr_put_u32(b, NFTA_HASH_SEED, 0);
+	nft_attr_put_u32(b, NFTA_HASH_OFFSET, 1);
+	nft_attr_put_u32(b, NFTA_HASH_TYPE, NFT_HASH_JENKINS);
+	nft_expr_end(b, &e);
+}
+
+static void add_prerouting_rules(struct nft_buf *b, const struct cip *c)
+{
+	unsigned char host = PACKET_HOST;
+	size_t m, l;
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		m = nft_msg_begin(b, NFT_MSG(NFT_MSG_NEWRULE), NFPROTO_IPV4,
+				  NLM_F_CREATE | NLM_F_APPEND | NLM_F_ACK);
+		nft_attr_put_str(b, NFTA_RULE_TABLE, c->table);
+		nft_attr_put_str(b, NFTA_RULE_CHAIN, "prerouting");
+		l = nft_nest_begin(b, NFTA_RULE_EXPRESSIONS);
+
+		expr_ifname(b, NFT_META_IIFNAME, c->nic);
+		nft_expr_payload(b, NFT_PAYLOAD_NETWORK_HEADER, 16, 4, NFT_REG_1);
+		nft_expr_cmp_eq(b, NFT_REG_1, &c->ip, 4);
+		if (i == 0) {
+			/* not our bucket */
+			expr_hash(b, c, NFT_REG32_00);
+			nft_expr_lookup(b, CIP_SET, CIP_SET_ID, NFT_REG32_00,
+					NFT_LOOKUP_F_INV);
+			nft_expr_drop(b);
+		} else {
+			/* our bucket: it came to a multicast MAC address */
+			nft_expr_immediate(b, NFT_REG32_00, &host, sizeof(host));
+			nft_expr_meta_set(b, NFT_META_PKTTYPE, NFT_REG32_00);
+		}
+
+		nft_nest_end(b, l);
+		nft_msg_end(b, m);
+	}
+}
+
+/* ARP requests and replies for ip carry the cluster MAC address */
+static void add_arp_rule(struct nft_buf *b, const struct cip *c)
+{
+	static const unsigned char ether[2] = { 0, 1 };
+	static const unsigned char lens[2] = { 6, 4 };
+	size_t m, l;
+
+	m = nft_msg_begin(b, NFT_MSG(NFT_MSG_NEWRULE), NFPROTO_ARP,
+			  NLM_F_CREATE | NLM_F_APPEND | NLM_F_ACK);
+	nft_attr_put_str(b, NFTA_RULE_TABLE, c->table);
+	nft_attr_put_str(b, NFTA_RULE_CHAIN, "output");
+	l = nft_nest_begin(b, NFTA_RULE_EXPRESSIONS);
+
+	expr_ifname(b, NFT_META_OIFNAME, c->nic);
+	nft_expr_payload(b, NFT_PAYLOAD_NETWORK_HEADER, 0, 2, NFT_REG_1);
+	nft_expr_cmp_eq(b, NFT_REG_1, ether, sizeof(ether));
+	nft_expr_payload(b, NFT_PAYLOAD_NETWORK_HEADER, 4, 2, NFT_REG_1);
+	nft_expr_cmp_eq(b, NFT_REG_1, lens, sizeof(lens));
+	nft_expr_payload(b, NFT_PAYLOAD_NETWORK_HEADER, 14, 4, NFT_REG_1);
+	nft_expr_cmp_eq(b, NFT_REG_1, &c->ip, 4);
+	nft_expr_immediate(b, NFT_REG_1, c->mac, sizeof(c->mac));
+	nft_expr_payload_set(b, NFT_PAYLOAD_NETWORK_HEADER, 8, 6, NFT_REG_1);
+
+	nft_nest_end(b, l);
+	nft_msg_end(b, m);
+}
+
+static void add_bucket(struct nft_buf *b, int type, int flags,
+		       const struct cip *c)
+{
+	size_t m, l, e, d;
+
+	m = nft_msg_begin(b, NFT_MSG(type), NFPROTO_IPV4, flags | NLM_F_ACK);
+	nft_attr_put_str(b, NFTA_SET_ELEM_LIST_TABLE, c->table);
+	nft_attr_put_str(b, NFTA_SET_ELEM_LIST_SET, CIP_SET);
+	l = nft_nest_begin(b, NFTA_SET_ELEM_LIST_ELEMENTS);
+	e = nft_nest_begin(b, NFTA_LIST_ELEM);
+	d = nft_nest_begin(b, NFTA_SET_ELEM_KEY);
+	/* hash results are in host byte order */
+	nft_attr_put(b, NFTA_DATA_VALUE, &c->bucket, sizeof(c->bucket));
+	nft_nest_end(b, d);
+	nft_nest_end(b, e);
+	nft_nest_end(b, l);
+	nft_msg_end(b, m);
+}
+
+/* receive frames for the cluster MAC address on nic */
+static int set_multicast(const struct cip *c, int add)
+{
+	struct ifreq ifr;
+	int fd, ret;
+
+	fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (fd < 0)
+		return -errno;
+	memset(&ifr, 0, sizeof(ifr));
+	strncpy(ifr.ifr_name, c->nic, sizeof(ifr.ifr_name) - 1);
+	ifr.ifr_hwaddr.sa_family = AF_UNSPEC;
+	memcpy(ifr.ifr_hwaddr.sa_data, c->mac, sizeof(c->mac));
+	ret = ioctl(fd, add ? SIOCADDMULTI : SIOCDELMULTI, &ifr);
+	ret = (ret < 0) ? -errno : 0;
+	close(fd);
+	return ret;
+}
+
+static struct nlattr *nla_data(const struct nlattr *a)
+{
+	return (struct nlattr *)(void *)((char *)(uintptr_t)a + NLA_HDRLEN);
+}
+
+static struct nlattr *nla_next(const struct nlattr *a)
+{
+	return (struct nlattr *)(void *)((char *)(uintptr_t)a
+					 + NLA_ALIGN(a->nla_len));
+}
+
+/* the number of attributes of type in the len bytes at a */
+static int count_attrs(const struct nlattr *a, int len, int type)
+{
+	int count = 0;
+
+	for (; len >= NLA_HDRLEN && a->nla_len >= NLA_HDRLEN
+	     && a->nla_len <= len;
+	     len -= NLA_ALIGN(a->nla_len), a = nla_next(a)) {
+		if ((a->nla_type & NLA_TYPE_MASK) == type)
+			count++;
+	}
+	return count;
+}
+
+/* the number of buckets in the set, or a negative errno */
+static int count_buckets(int fd, const struct cip *c)
+{
+	char rbuf[16384];
+	struct nft_buf b;
+	struct nlmsghdr *h;
+	struct nlmsgerr *err;
+	struct nlattr *a;
+	ssize_t rlen;
+	size_t m;
+	int len;
+	int count = 0;
+
+	memset(&b, 0, sizeof(b));
+	m = nft_msg_begin(&b, NFT_MSG(NFT_MSG_GETSETELEM), NFPROTO_IPV4,
+			  NLM_F_DUMP);
+	nft_attr_put_str(&b, NFTA_SET_ELEM_LIST_TABLE, c->table);
+	nft_attr_put_str(&b, NFTA_SET_ELEM_LIST_SET, CIP_SET);
+	nft_msg_end(&b, m);
+	if (send(fd, b.data, b.len, 0) < 0) {
+		free(b.data);
+		return -errno;
+	}
+	free(b.data);
+
+	/* elements come as NFTA_LIST_ELEM in NFTA_SET_ELEM_LIST_ELEMENTS
+	 * nests, a message may carry many of them */
+	for (;;) {
+		rlen = recv(fd, rbuf, sizeof(rbuf), 0);
+		if (rlen < 0) {
+			if (errno == EINTR)
+				continue;
+			/* the receive timeout of nft_open() */
+			if (errno == EAGAIN || errno == EWOULDBLOCK)
+				return -ETIMEDOUT;
+			return -errno;
+		}
+		for (h = (struct nlmsghdr *)(void *)rbuf; NLMSG_OK(h, rlen);
+		     h = NLMSG_NEXT(h, rlen)) {
+			if (h->nlmsg_type == NLMSG_DONE)
+				return count;
+			if (h->nlmsg_type == NLMSG_ERROR) {
+				err = NLMSG_DATA(h);
+				return err->error;
+			}
+			if (h->nlmsg_type != NFT_MSG(NFT_MSG_NEWSETELEM))
+				continue;
+			len = NLMSG_PAYLOAD(h, sizeof(struct nfgenmsg));
+			a = (struct nlattr *)(void *)((char *)NLMSG_DATA(h)
+				+ NLMSG_ALIGN(sizeof(struct nfgenmsg)));
+			for (; len >= NLA_HDRLEN && a->nla_len >= NLA_HDRLEN
+			     && a->nla_len <= len;
+			     len -= NLA_ALIGN(a->nla_len), a = nla_next(a)) {
+				if ((a->nla_type & NLA_TYPE_MASK) == NFTA_SET_ELEM_LIST_ELEMENTS)
+					count += count_attrs(nla_data(a),
+						a->nla_len - NLA_HDRLEN,
+						NFTA_LIST_ELEM);
+			}
+		}
+	}
+}
+
+static int cip_start(int fd, const struct cip *c)
+{
+	struct nft_buf b;
+	size_t m;
+	int ret;
+
+	memset(&b, 0, sizeof(b));
+	nft_batch_begin(&b);
+	add_table(&b, NFPROTO_IPV4, c->table, NLM_F_CREATE | NLM_F_EXCL);
+	add_chain(&b, NFPROTO_IPV4, c->table, "prerouting",
+		  NF_INET_PRE_ROUTING);
+	m = nft_msg_begin(&b, NFT_MSG(NFT_MSG_NEWSET), NFPROTO_IPV4,
+			  NLM_F_CREATE | NLM_F_ACK);
+	nft_attr_put_str(&b, NFTA_SET_TABLE, c->table);
+	nft_attr_put_str(&b, NFTA_SET_NAME, CIP_SET);
+	nft_attr_put_u32(&b, NFTA_SET_FLAGS, 0);
+	nft_attr_put_u32(&b, NFTA_SET_KEY_TYPE, NFT_TYPE_MARK);
+	nft_attr_put_u32(&b, NFTA_SET_KEY_LEN, sizeof(c->bucket));
+	nft_attr_put_u32(&b, NFTA_SET_ID, CIP_SET_ID);
+	nft_msg_end(&b, m);
+	add_prerouting_rules(&b, c);
+	add_table(&b, NFPROTO_ARP, c->table, NLM_F_CREATE);
+	add_chain(&b, NFPROTO_ARP, c->table, "output", NF_ARP_OUT);
+	add_arp_rule(&b, c);
+	nft_batch_end(&b);
+
+	ret = nft_talk(fd, &b);
+	if (ret == 0) {
+		ret = set_multicast(c, 1);
+		if (ret < 0)
+			fprintf(stderr, "Failed to add multicast address on %s (%s)\n",
+				c->nic, strerror(-ret));
+	} else if (ret == -EEXIST) {
+		/* not the first bucket on this node */
+		ret = 0;
+	} else {
+		fprintf(stderr, "Failed to create table %s (%s)\n",
+			c->table, strerror(-ret));
+	}
+
+	if (ret == 0) {
+		nft_batch_begin(&b);
+		add_bucket(&b, NFT_MSG_NEWSETELEM, NLM_F_CREATE, c);
+		nft_batch_end(&b);
+		ret = nft_talk(fd, &b);
+		if (ret < 0)
+			fprintf(stderr, "Failed to add bucket %u (%s)\n",
+				c->bucket, strerror(-ret));
+	}
+	free(b.data);
+	return ret ? CIP_ERROR : CIP_OK;
+}
+
+static int cip_stop(int fd, const struct cip *c)
+{
+	struct nft_buf b;
+	int ret;
+
+	memset(&b, 0, sizeof(b));
+	nft_batch_begin(&b);
+	add_bucket(&b, NFT_MSG_DELSETELEM, 0, c);
+	nft_batch_end(&b);
+	ret = nft_talk(fd, &b);
+	/* no such bucket, or no table at all */
+	if (ret == -ENOENT)
+		ret = 0;
+	if (ret == 0)
+		ret = count_buckets(fd, c);
+	if (ret == -ENOENT)
+		ret = 0;
+	if (ret < 0) {
+		fprintf(stderr, "Failed to remove bucket %u (%s)\n",
+			c->bucket, strerror(-ret));
+		free(b.data);
+		return CIP_ERROR;
+	}
+	if (ret > 0) {
+		free(b.data);
+		return CIP_MORE;
+	}
+
+	/* that was the last one, remove what is left of both tables */
+	ret = del_table(fd, &b, NFPROTO_IPV4, c->table);
+	if (ret == 0)
+		ret = del_table(fd, &b, NFPROTO_ARP, c->table);
+	free(b.data);
+	if (ret < 0) {
+		fprintf(stderr, "Failed to remove table %s (%s)\n",
+			c->table, strerror(-ret));
+		return CIP_ERROR;
+	}
+	ret = set_multicast(c, 0);
+	if (ret < 0 && ret != -ENOENT) {
+		fprintf(stderr, "Failed to remove multicast address on %s (%s)\n",
+			c->nic, strerror(-ret));
+		return CIP_ERROR;
+	}
+	return CIP_OK;
+}
+
+/* as ip_served(): "ok", "partial" (not our bucket) or "partial2" (no rules) */
+static const char *cip_status(int fd, const struct cip *c)
+{
+	struct nft_buf b;
+	size_t m;
+	int ret;
+
+	memset(&b, 0, sizeof(b));
+	m = nft_msg_begin(&b, NFT_MSG(NFT_MSG_GETSET), NFPROTO_IPV4, NLM_F_ACK);
+	nft_attr_put_str(&b, NFTA_SET_TABLE, c->table);
+	nft_attr_put_str(&b, NFTA_SET_NAME, CIP_SET);
+	nft_msg_end(&b, m);
+	ret = nft_talk(fd, &b);
+	if (ret == 0) {
+		add_bucket(&b, NFT_MSG_GETSETELEM, 0, c);
+		ret = nft_talk(fd, &b);
+		if (ret == -ENOENT) {
+			free(b.data);
+			return "partial";
+		}
+	} else if (ret == -ENOENT) {
+		free(b.data);
+		return "partial2";
+	}
+	free(b.data);
+	if (ret < 0) {
+		fprintf(stderr, "Failed to look up bucket %u (%s)\n",
+			c->bucket, strerror(-ret));
+		return NULL;
+	}
+	return "ok";
+}
+
+/* ip nic mac total hashmode bucket */
+static int parse_args(char **argv, struct cip *c)
+{
+	unsigned int mac[6];
+	char *end, *p;
+	unsigned long n;
+	int i;
+
+	memset(c, 0, sizeof(*c));
+	if (inet_pton(AF_INET, argv[0], &c->ip) != 1) {
+		fprintf(stderr, "Bad IPv4 address %s\n", argv[0]);
+		return -1;
+	}
+	snprintf(c->table, sizeof(c->table), "ipaddr2_cip_%s", argv[0]);
+	for (p = c->table; *p; p++) {
+		if (*p == '.')
+			*p = '_';
+	}
+
+	c->nic = argv[1];
+	if (!*c->nic || strlen(c->nic) >= IFNAMSIZ) {
+		fprintf(stderr, "Bad interface name %s\n", argv[1]);
+		return -1;
+	}
+
+	if (sscanf(argv[2], "%2x:%2x:%2x:%2x:%2x:%2x", &mac[0], &mac[1],
+		   &mac[2], &mac[3], &mac[4], &mac[5]) != 6
+	    || !(mac[0] & 1)) {
+		fprintf(stderr, "Bad multicast MAC address %s\n", argv[2]);
+		return -1;
+	}
+	for (i = 0; i < 6; i++)
+		c->mac[i] = mac[i];
+
+	n = strtoul(argv[3], &end, 10);
+	if (end == argv[3] || *end || n < 1 || n > 65535) {
+		fprintf(stderr, "Bad number of buckets %s\n", argv[3]);
+		return -1;
+	}
+	c->total = n;
+
+	if (strcmp(argv[4], "sourceip") == 0) {
+		c->hashlen = 4;
+	} else if (strcmp(argv[4], "sourceip-sourceport") == 0) {
+		c->hashlen = 8;
+	} else if (strcmp(argv[4], "sourceip-sourceport-destport") == 0) {
+		c->hashlen = 12;
+	} else {
+		fprintf(stderr, "Bad hash mode %s\n", argv[4]);
+		return -1;
+	}
+
+	n = strtoul(argv[5], &end, 10);
+	if (end == argv[5] || *end || n < 1 || n > c->total) {
+		fprintf(stderr, "Bad bucket %s\n", argv[5]);
+		return -1;
+	}
+	c->bucket = n;
+	return 0;
+}
+
+static void usage(void)
+{
+	printf("Usage: /usr/lib/heartbeat/clusterip_nft {start|stop|status|parse} ip nic mac total hashmode bucket\n");
+	printf("  start   serve bucket of the cluster ip\n");
+	printf("  stop    stop serving it; exits with 1 if other buckets are still served\n");
+	printf("  status  print ok, partial (bucket not served) or partial2 (not set up)\n");
+	printf("  parse   only check the arguments\n");
+	printf("mac is the multicast MAC address of the cluster ip, total the number of\n");
+	printf("buckets, hashmode sourceip, sourceip-sourceport or\n");
+	printf("sourceip-sourceport-destport.\n");
+	printf("Exits with 2 on errors.\n");
+	exit(CIP_ERROR);
+}
+
+int main(int argc, char *argv[])
+{
+	struct cip c;
+	const char *cmd, *status;
+	int fd, ret;
+
+	if (argc != 8) {
+		usage();
+	}
+	cmd = argv[1];
+	if (strcmp(cmd, "start") && strcmp(cmd, "stop")
+	    && strcmp(cmd, "status") && strcmp(cmd, "parse")) {
+		usage();
+	}
+	if (parse_args(argv + 2, &c) < 0) {
+		exit(CIP_ERROR);
+	}
+	if (strcmp(cmd, "parse") == 0) {
+		exit(CIP_OK);
+	}
+
+	fd = nft_open();
+	if (fd < 0) {
+		exit(CIP_ERROR);
+	}
+
+	if (strcmp(cmd, "start") == 0) {
+		ret = cip_start(fd, &c);
+	} else if (strcmp(cmd, "stop") == 0) {
+		ret = cip_stop(fd, &c);
+	} else {
+		status = cip_status(fd, &c);
+		if (status)
+			printf("%s\n", status);
+		ret = status ? CIP_OK : CIP_ERROR;
+	}
+
+	close(fd);
+	return ret;
+}
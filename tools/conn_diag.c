@@ -0,0 +1,349 @@
+/*
+ * TCP connection enumeration through sock_diag (INET_DIAG) netlink.
+ *
+ * Used instead of parsing netstat or ss output: the kernel filters the
+ * sockets on the local address with an inet_diag bytecode program, so
+ * on hosts with a very large number of sockets only the interesting
+ * ones are ever copied to user space.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <linux/netlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+
+#include "conn_diag.h"
+
+#define DIAG_BUFSIZE	65536
+
+/* the largest filter: address, port >= lo, port <= hi */
+struct diag_req {
+	struct nlmsghdr nlh;
+	struct inet_diag_req_v2 r;
+	struct nlattr nla;
+	unsigned char bc[sizeof(struct inet_diag_bc_op)
+			 + sizeof(struct inet_diag_hostcond) + 16
+			 + 4 * sizeof(struct inet_diag_bc_op)];
+};
+
+static int diag_open(void);
+static int diag_bytecode(unsigned char *bc, const struct sockaddr *local,
+			 unsigned port_lo, unsigned port_hi);
+static int diag_request(int fd, int family, const struct sockaddr *local,
+			unsigned port_lo, unsigned port_hi, unsigned states,
+			uint32_t seq);
+static int diag_report(const struct inet_diag_msg *msg,
+		       conn_diag_cb cb, void *arg);
+static int diag_dump_family(int fd, int family,
+			    const struct sockaddr *local,
+			    unsigned port_lo, unsigned port_hi, unsigned states,
+			    conn_diag_cb cb, void *arg);
+
+static int diag_open(void)
+{
+	int fd;
+	struct sockaddr_nl snl;
+
+	fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+	if (fd < 0) {
+		if (errno == EAFNOSUPPORT)
+			errno = EPROTONOSUPPORT;
+		return -1;
+	}
+
+	memset(&snl, 0, sizeof(snl));
+	snl.nl_family = AF_NETLINK;
+	if (bind(fd, (struct sockaddr *)&snl, sizeof(snl)) < 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * Build the filter program into bc and return its length. It is a
+ * chain of conditions on the local address and port range: each
+ * condition that holds steps to the next one, and the last one runs
+ * off the end of the program (accept); a condition that fails jumps 4
+ * bytes past the end (reject).
+ */
+static int diag_bytecode(unsigned char *bc, const struct sockaddr *local,
+			 unsigned port_lo, unsigned port_hi)
+{
+	const struct sockaddr_in *sin = (const struct sockaddr_in *)local;
+	const struct sockaddr_in6 *sin6 = (const struct sockaddr_in6 *)local;
+	struct inet_diag_bc_op op[2];
+	struct inet_diag_hostcond cond;
+	int addrlen, len, total, i;
+	int sizes[3];
+
+	addrlen = (local->sa_family == AF_INET) ? 4 : 16;
+	sizes[0] = sizeof(op[0]) + sizeof(cond) + addrlen;
+	sizes[1] = sizes[2] = 0;
+	if (port_lo || port_hi) {
+		sizes[1] = sizes[2] = 2 * sizeof(op[0]);
+	}
+	total = sizes[0] + sizes[1] + sizes[2];
+
+	len = 0;
+	memset(&cond, 0, sizeof(cond));
+	cond.family = local->sa_family;
+	cond.port = -1;
+	op[0].code = INET_DIAG_BC_S_COND;
+	op[0].yes = sizes[0];
+	op[0].no = total + 4;
+	memcpy(bc, &op[0], sizeof(op[0]));
+	len += sizeof(op[0]);
+	if (local->sa_family == AF_INET) {
+		cond.prefix_len = 32;
+		memcpy(bc + len + sizeof(cond), &sin->sin_addr, 4);
+	} else {
+		cond.prefix_len = 128;
+		memcpy(bc + len + sizeof(cond), &sin6->sin6_addr, 16);
+	}
+	memcpy(bc + len, &cond, sizeof(cond));
+	len += sizeof(cond) + addrlen;
+
+	/* the port to compare with is in the "no" of a second op */
+	for (i = 1; i < 3 && sizes[i]; i++) {
+		op[0].code = (i == 1) ? INET_DIAG_BC_S_GE : INET_DIAG_BC_S_LE;
+		op[0].yes = sizes[i];
+		op[0].no = total - len + 4;
+		op[1].code = INET_DIAG_BC_NOP;
+		op[1].yes = 0;
+		op[1].no = (i == 1) ? port_lo : port_hi;
+		memcpy(bc + len, op, sizeof(op));
+		len += sizeof(op);
+	}
+	return len;
+}
+
+/* send one dump request for the sockets of the given family */
+static int diag_request(int fd, int family, const struct sockaddr *local,
+			unsigned port_lo, unsigned port_hi, unsigned states,
+			uint32_t seq)
+{
+	struct diag_req req;
+	struct sockaddr_nl snl;
+	int bclen;
+
+	memset(&req, 0, sizeof(req));
+	bclen = diag_bytecode(req.bc, local, port_lo, port_hi);
+	req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(req.r))
+			  + NLA_HDRLEN + bclen;
+	req.nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+	req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.nlh.nlmsg_seq = seq;
+	req.r.sdiag_family = family;
+	req.r.sdiag_protocol = IPPROTO_TCP;
+	req.r.idiag_states = states;
+	req.nla.nla_type = INET_DIAG_REQ_BYTECODE;
+	req.nla.nla_len = NLA_HDRLEN + bclen;
+
+	memset(&snl, 0, sizeof(snl));
+	snl.nl_family = AF_NETLINK;
+	if (sendto(fd, &req, req.nlh.nlmsg_len, 0,
+		   (struct sockaddr *)&snl, sizeof(snl)) < 0) {
+		return -1;
+	}
+	return 0;
+}
+
+static int diag_report(const struct inet_diag_msg *msg,
+		       conn_diag_cb cb, void *arg)
+{
+	union {
+		struct sockaddr sa;
+		struct sockaddr_in ip;
+		struct sockaddr_in6 ip6;
+	} src, dst;
+	static const uint32_t v4mapped[3] = { 0, 0, 0 };
+	int mapped;
+
+	memset(&src, 0, sizeof(src));
+	memset(&dst, 0, sizeof(dst));
+
+	mapped = msg->idiag_family == AF_INET6
+		&& memcmp(msg->id.idiag_src, v4mapped, 8) == 0
+		&& msg->id.idiag_src[2] == htonl(0xffff);
+
+	if (msg->idiag_family == AF_INET || mapped) {
+		src.ip.sin_family = AF_INET;
+		src.ip.sin_port = msg->id.idiag_sport;
+		dst.ip.sin_family = AF_INET;
+		dst.ip.sin_port = msg->id.idiag_dport;
+		memcpy(&src.ip.sin_addr, &msg->id.idiag_src[mapped ? 3 : 0], 4);
+		memcpy(&dst.ip.sin_addr, &msg->id.idiag_dst[mapped ? 3 : 0], 4);
+	} else {
+		src.ip6.sin6_family = AF_INET6;
+		src.ip6.sin6_port = msg->id.idiag_sport;
+		dst.ip6.sin6_family = AF_INET6;
+		dst.ip6.sin6_port = msg->id.idiag_dport;
+		memcpy(&src.ip6.sin6_addr, msg->id.idiag_src, 16);
+		memcpy(&dst.ip6.sin6_addr, msg->id.idiag_dst, 16);
+	}
+
+	return cb(&src.sa, &dst.sa, arg);
+}
+
+static int diag_dump_family(int fd, int family,
+			    const struct sockaddr *local,
+			    unsigned port_lo, unsigned port_hi, unsigned states,
+			    conn_diag_cb cb, void *arg)
+{
+	static uint32_t seq;
+	char *buf;
+	struct nlmsghdr *nlh;
+	struct nlmsgerr *err;
+	ssize_t len;
+	int ret = 0;
+	int done = 0;
+
+	buf = malloc(DIAG_BUFSIZE);
+	if (!buf) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	if (diag_request(fd, family, local, port_lo, port_hi, states,
+			 ++seq) < 0) {
+		free(buf);
+		return -1;
+	}
+
+	/*
+	 * Once the callback asked to stop, keep draining until DONE, so
+	 * that the socket can be reused for the next family.
+	 */
+	while (!done) {
+		len = recv(fd, buf, DIAG_BUFSIZE, 0);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			ret = -1;
+			break;
+		}
+		if (len == 0) {
+			errno = EIO;
+			ret = -1;
+			break;
+		}
+
+		for (nlh = (struct nlmsghdr *)buf; NLMSG_OK(nlh, len);
+		     nlh = NLMSG_NEXT(nlh, len)) {
+			if (nlh->nlmsg_seq != seq)
+				continue;
+			if (nlh->nlmsg_type == NLMSG_DONE) {
+				done = 1;
+				break;
+			}
+			if (nlh->nlmsg_type == NLMSG_ERROR) {
+				err = NLMSG_DATA(nlh);
+				/* old kernels: no SOCK_DIAG_BY_FAMILY */
+				errno = (err->error == -EINVAL
+					 || err->error == -ENOENT)
+					? EPROTONOSUPPORT : -err->error;
+				ret = -1;
+				done = 1;
+				break;
+			}
+			if (nlh->nlmsg_type != SOCK_DIAG_BY_FAMILY || ret)
+				continue;
+			ret = diag_report(NLMSG_DATA(nlh), cb, arg);
+		}
+	}
+
+	free(buf);
+	return ret;
+}
+
+int conn_diag_dump(const struct sockaddr *local,
+		   unsigned port_lo, unsigned port_hi, unsigned states,
+		   conn_diag_cb cb, void *arg)
+{
+	int fd;
+	int ret;
+	int saved_errno;
+
+	if (local->sa_family != AF_INET && local->sa_family != AF_INET6) {
+		errno = EAFNOSUPPORT;
+		return -1;
+	}
+	if (port_hi < port_lo || port_hi > 65535) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	fd = diag_open();
+	if (fd < 0)
+		return -1;
+
+	/* IPv4 connections may also live on dual stack IPv6 sockets */
+	ret = 0;
+	if (local->sa_family == AF_INET)
+		ret = diag_dump_family(fd, AF_INET, local, port_lo, port_hi,
+				       states, cb, arg);
+	if (ret == 0) {
+		ret = diag_dump_family(fd, AF_INET6, local, port_lo, port_hi,
+				       states, cb, arg);
+		/* IPv6 may be disabled, that is no error for IPv4 */
+		if (ret == -1 && errno == EPROTONOSUPPORT
+		    && local->sa_family == AF_INET)
+			ret = 0;
+	}
+
+	saved_errno = errno;
+	close(fd);
+	errno = saved_errno;
+	return ret;
+}
+
+int conn_diag_parse_ports(const char *s, unsigned *port_lo,
+			  unsigned *port_hi)
+{
+	char *endp;
+	unsigned long lo, hi;
+
+	lo = strtoul(s, &endp, 10);
+	if (endp == s) {
+		return -1;
+	}
+	hi = lo;
+	if (*endp == '-') {
+		s = endp + 1;
+		hi = strtoul(s, &endp, 10);
+		if (endp == s) {
+			return -1;
+		}
+	}
+	if (*endp != 0 || lo == 0 || hi < lo || hi > 65535) {
+		return -1;
+	}
+	*port_lo = lo;
+	*port_hi = hi;
+	return 0;
+}
@@ -0,0 +1,57 @@
+/*
+ * TCP connection enumeration through sock_diag (INET_DIAG) netlink.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef CONN_DIAG_H
+#define CONN_DIAG_H
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+/* TCP state masks for conn_diag_dump(), bits are (1 << TCP_xxx) */
+#define CONN_DIAG_ESTABLISHED	(1U << 1)
+/* everything netstat -tn shows: all states but LISTEN and CLOSE */
+#define CONN_DIAG_CONNECTED	(0xFFEU & ~((1U << 7) | (1U << 10)))
+
+/*
+ * Called for every matching connection. local and remote are
+ * sockaddr_in or sockaddr_in6 with the port set; IPv4 connections on
+ * IPv6 sockets are reported as sockaddr_in. A non-zero return stops
+ * the dump and is passed back to the caller.
+ */
+typedef int (*conn_diag_cb)(const struct sockaddr *local,
+			    const struct sockaddr *remote, void *arg);
+
+/*
+ * Dump the TCP connections in the given states whose local address is
+ * that of local, and whose local port is within port_lo..port_hi
+ * unless both are 0 (the port of local is not used). The filter runs
+ * in the kernel, so only matching sockets are copied out.
+ * Returns 0, the non-zero callback return, or -1 with errno set;
+ * errno is EPROTONOSUPPORT if the kernel has no sock_diag.
+ */
+int conn_diag_dump(const struct sockaddr *local,
+		   unsigned port_lo, unsigned port_hi, unsigned states,
+		   conn_diag_cb cb, void *arg);
+
+/* parse "port" or "port-port"; returns 0 or -1 */
+int conn_diag_parse_ports(const char *s, unsigned *port_lo,
+			  unsigned *port_hi);
+
+#endif /* CONN_DIAG_H */
@@ -0,0 +1,905 @@
+/*
+   link health probe for the ethmonitor resource agent
+
+   Gives one verdict per interface, like if_check() in ethmonitor, but
+   without running ip, sed and arping in a loop:
+
+   - the carrier state and RX packet counter come from RTM_GETLINK
+     (IFLA_STATS64), one dump for all interfaces every 100ms, and link
+     changes arrive as RTNLGRP_LINK events, so a link that goes down
+     while we watch the counters is reported at once;
+   - if no packets were received within the packet counter timeout,
+     ARP requests go out to the most recently confirmed neighbours of
+     each such interface all at once, from our own PF_PACKET sockets,
+     and the first reply or one shared deadline decides.
+
+   With -d it keeps running instead: every repeat_interval seconds it
+   checks again, and it reports a link that goes away as soon as the
+   kernel tells. The node attribute of every interface is updated with
+   attrd_updater, and the verdicts written to a state file, only when
+   the verdict of an interface changes.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <syslog.h>
+#include <sys/wait.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <net/if_arp.h>
+#include <netpacket/packet.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/if_ether.h>
+
+#include "rtnl_util.h"
+#include "ocf_util.h"
+
+/* exit codes */
+#define PROBE_ALL_UP	0
+#define PROBE_SOME_DOWN	1
+#define PROBE_ERROR	2
+
+#define PROBE_TICK_MS		100	/* RX counter poll interval */
+#define PROBE_ARP_INTERVAL_MS	1000	/* as arping */
+#define PROBE_MAX_TARGETS	64
+#define PROBE_HWADDR_LEN	32
+
+enum verdict {
+	PENDING,
+	UP,
+	DOWN
+};
+
+struct probe_if {
+	const char *name;
+	int ifindex;		/* 0 until seen in a dump */
+	unsigned flags;
+	unsigned short type;	/* ARPHRD_xxx */
+	unsigned char hwaddr[PROBE_HWADDR_LEN];
+	unsigned char brdaddr[PROBE_HWADDR_LEN];
+	int hwlen;
+	uint64_t rx_packets;
+	uint64_t rx_base;
+	enum verdict verdict;
+	const char *reason;
+
+	/* ARP phase */
+	int sock;
+	int ntargets;
+	struct in_addr target[PROBE_MAX_TARGETS];
+	struct in_addr source[PROBE_MAX_TARGETS];
+
+	/* daemon mode */
+	const char *attr;
+	unsigned long multiplier;
+	enum verdict published;	/* PENDING until the first update */
+	const char *published_reason;
+	unsigned fails;		/* consecutive failed checks */
+};
+
+struct probe_opts {
+	int link_only;
+	unsigned pktcnt_timeout;
+	unsigned arping_count;
+	unsigned arping_timeout;
+	int entries;
+	/* daemon mode */
+	unsigned repeat_interval;
+	unsigned repeat_count;
+	const char *statefile;
+};
+
+struct neigh {
+	struct in_addr addr;
+	uint32_t confirmed;	/* age in clock ticks */
+};
+
+struct neigh_list {
+	int ifindex;
+	struct neigh *entries;
+	int count;
+};
+
+static struct probe_if *ifs;
+static int nifs;
+static int verbose;
+static const struct probe_opts *daemon_opts;
+
+static struct probe_if *find_if(const char *name, int ifindex);
+static void link_msg(struct nlmsghdr *h, void *arg);
+static int link_dump(int fd);
+static void set_verdict(struct probe_if *p, enum verdict v, const char *reason);
+static void check_links(int link_only);
+static void watch_rx(int qfd, int efd, unsigned timeout_s);
+static void neigh_msg(struct nlmsghdr *h, void *arg);
+static int neigh_cmp(const void *a, const void *b);
+static int find_targets(int fd, struct probe_if *p, int max);
+static void pick_source(struct probe_if *p, int i);
+static int arp_open(struct probe_if *p);
+static void arp_send(struct probe_if *p, int i);
+static int arp_recv(struct probe_if *p);
+static int arp_probe(int fd, unsigned count, unsigned timeout_s,
+		     int entries);
+static int probe_round(int qfd, int efd, const struct probe_opts *o);
+static int link_lost(const struct probe_if *p);
+static void print_state(FILE *f, void *arg);
+static void publish(struct probe_if *p, enum verdict v, const char *reason);
+static void report(struct probe_if *p);
+static int wait_events(int efd, long until);
+static int run_daemon(int qfd, int efd, const struct probe_opts *o);
+static int parse_spec(struct probe_if *p, char *spec);
+static void usage(void);
+
+static struct probe_if *find_if(const char *name, int ifindex)
+{
+	int i;
+
+	for (i = 0; i < nifs; i++) {
+		if (name ? strcmp(ifs[i].name, name) == 0
+			 : ifs[i].ifindex == ifindex)
+			return &ifs[i];
+	}
+	return NULL;
+}
+
+/* RTM_NEWLINK and RTM_DELLINK, from dumps and events */
+static void link_msg(struct nlmsghdr *h, void *arg)
+{
+	struct ifinfomsg *ifi;
+	struct rtattr *rta;
+	int len;
+	struct rtnl_link_stats64 st64;
+	struct rtnl_link_stats st;
+	struct probe_if *p;
+	const char *name = NULL;
+	int have64 = 0;
+
+	(void)arg;
+	/* missed events: the next dump catches up */
+	if (!h)
+		return;
+	if (h->nlmsg_type != RTM_NEWLINK && h->nlmsg_type != RTM_DELLINK)
+		return;
+
+	ifi = NLMSG_DATA(h);
+	len = IFLA_PAYLOAD(h);
+	for (rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type == IFLA_IFNAME)
+			name = RTA_DATA(rta);
+	}
+	p = name ? find_if(name, 0) : find_if(NULL, ifi->ifi_index);
+	if (!p)
+		return;
+	if (h->nlmsg_type == RTM_DELLINK) {
+		p->ifindex = 0;
+		p->flags = 0;
+		return;
+	}
+
+	p->ifindex = ifi->ifi_index;
+	p->flags = ifi->ifi_flags;
+	p->type = ifi->ifi_type;
+	len = IFLA_PAYLOAD(h);
+	for (rta = IFLA_RTA(ifi); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		switch (rta->rta_type) {
+		case IFLA_ADDRESS:
+			if (RTA_PAYLOAD(rta) <= PROBE_HWADDR_LEN) {
+				p->hwlen = RTA_PAYLOAD(rta);
+				memcpy(p->hwaddr, RTA_DATA(rta), p->hwlen);
+			}
+			break;
+		case IFLA_BROADCAST:
+			if (RTA_PAYLOAD(rta) <= PROBE_HWADDR_LEN)
+				memcpy(p->brdaddr, RTA_DATA(rta), RTA_PAYLOAD(rta));
+			break;
+		case IFLA_STATS64:
+			if (RTA_PAYLOAD(rta) >= sizeof(st64)) {
+				memcpy(&st64, RTA_DATA(rta), sizeof(st64));
+				p->rx_packets = st64.rx_packets;
+				have64 = 1;
+			}
+			break;
+		case IFLA_STATS:
+			/* only older kernels lack IFLA_STATS64 */
+			if (!have64 && RTA_PAYLOAD(rta) >= sizeof(st)) {
+				memcpy(&st, RTA_DATA(rta), sizeof(st));
+				p->rx_packets = st.rx_packets;
+			}
+			break;
+		}
+	}
+}
+
+static int link_dump(int fd)
+{
+	static uint32_t seq;
+
+	if (rtnl_dump(fd, RTM_GETLINK, AF_UNSPEC, ++seq) < 0)
+		return -1;
+	return rtnl_read(fd, seq, 1, link_msg, NULL);
+}
+
+static void set_verdict(struct probe_if *p, enum verdict v, const char *reason)
+{
+	if (p->verdict != PENDING)
+		return;
+	p->verdict = v;
+	p->reason = reason;
+	if (verbose)
+		fprintf(stderr, "%s: %s (%s)\n", p->name,
+			v == UP ? "up" : "down", reason);
+	/* the daemon does not wait for the end of the round for these */
+	if (daemon_opts && link_lost(p))
+		report(p);
+}
+
+/* "ip link show up" without NO-CARRIER */
+static void check_links(int link_only)
+{
+	int i;
+
+	for (i = 0; i < nifs; i++) {
+		if (!ifs[i].ifindex)
+			set_verdict(&ifs[i], DOWN, "missing");
+		else if (!(ifs[i].flags & IFF_UP) || !(ifs[i].flags & IFF_RUNNING))
+			set_verdict(&ifs[i], DOWN, "link");
+		else if (link_only)
+			set_verdict(&ifs[i], UP, "link");
+	}
+}
+
+/*
+ * Wait up to timeout_s seconds for the RX counters of the pending
+ * interfaces to move, and for link events in between.
+ */
+static void watch_rx(int qfd, int efd, unsigned timeout_s)
+{
+	struct pollfd pfd;
+	long deadline, next, now;
+	int i, pending;
+
+	for (i = 0; i < nifs; i++)
+		ifs[i].rx_base = ifs[i].rx_packets;
+
+	now = now_ms();
+	deadline = now + timeout_s * 1000L;
+	next = now + PROBE_TICK_MS;
+	for (;;) {
+		pending = 0;
+		for (i = 0; i < nifs; i++) {
+			if (ifs[i].verdict == PENDING)
+				pending++;
+		}
+		if (!pending || now >= deadline)
+			return;
+
+		pfd.fd = efd;
+		pfd.events = POLLIN;
+		if (efd >= 0 && poll(&pfd, 1, next > now ? next - now : 0) > 0) {
+			if (rtnl_read(efd, 0, 0, link_msg, NULL) < 0)
+				return;
+			check_links(0);
+		} else if (efd < 0 && next > now) {
+			poll(NULL, 0, next - now);
+		}
+
+		now = now_ms();
+		if (now < next)
+			continue;
+		next = now + PROBE_TICK_MS;
+		if (link_dump(qfd) < 0)
+			return;
+		check_links(0);
+		for (i = 0; i < nifs; i++) {
+			if (ifs[i].rx_packets != ifs[i].rx_base)
+				set_verdict(&ifs[i], UP, "rx");
+		}
+	}
+}
+
+static void neigh_msg(struct nlmsghdr *h, void *arg)
+{
+	struct neigh_list *l = arg;
+	struct ndmsg *ndm = NLMSG_DATA(h);
+	struct rtattr *rta;
+	int len = RTM_PAYLOAD(h);
+	struct nda_cacheinfo ci;
+	struct neigh n, *e;
+	int have_addr = 0;
+
+	if (h->nlmsg_type != RTM_NEWNEIGH || ndm->ndm_family != AF_INET
+	    || ndm->ndm_ifindex != l->ifindex
+	    || (ndm->ndm_state & (NUD_NOARP | NUD_PERMANENT))
+	    || ndm->ndm_state == NUD_NONE)
+		return;
+
+	memset(&n, 0, sizeof(n));
+	n.confirmed = UINT32_MAX;
+	for (rta = RTM_RTA(ndm); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type == NDA_DST && RTA_PAYLOAD(rta) == 4) {
+			memcpy(&n.addr, RTA_DATA(rta), 4);
+			have_addr = 1;
+		} else if (rta->rta_type == NDA_CACHEINFO
+			   && RTA_PAYLOAD(rta) >= sizeof(ci)) {
+			memcpy(&ci, RTA_DATA(rta), sizeof(ci));
+			n.confirmed = ci.ndm_confirmed;
+		}
+	}
+	if (!have_addr)
+		return;
+
+	e = realloc(l->entries, (l->count + 1) * sizeof(*e));
+	if (!e) {
+		fprintf(stderr, "Failed realloc()\n");
+		exit(PROBE_ERROR);
+	}
+	l->entries = e;
+	l->entries[l->count++] = n;
+}
+
+static int neigh_cmp(const void *a, const void *b)
+{
+	const struct neigh *x = a, *y = b;
+
+	if (x->confirmed != y->confirmed)
+		return x->confirmed < y->confirmed ? -1 : 1;
+	return 0;
+}
+
+/* the max most recently confirmed IPv4 neighbours of p */
+static int find_targets(int fd, struct probe_if *p, int max)
+{
+	static uint32_t seq;
+	struct neigh_list l;
+	int i;
+
+	memset(&l, 0, sizeof(l));
+	l.ifindex = p->ifindex;
+	if (rtnl_dump(fd, RTM_GETNEIGH, AF_INET, ++seq) < 0
+	    || rtnl_read(fd, seq, 1, neigh_msg, &l) < 0) {
+		free(l.entries);
+		return -1;
+	}
+	if (l.count)
+		qsort(l.entries, l.count, sizeof(*l.entries), neigh_cmp);
+	if (max > PROBE_MAX_TARGETS)
+		max = PROBE_MAX_TARGETS;
+	for (i = 0; i < l.count && i < max; i++) {
+		p->target[i] = l.entries[i].addr;
+		pick_source(p, i);
+	}
+	p->ntargets = i;
+	free(l.entries);
+	return 0;
+}
+
+/*
+ * The source address the kernel would use for the target on this
+ * interface, as arping does; 0.0.0.0 (an ARP probe) if there is none.
+ */
+static void pick_source(struct probe_if *p, int i)
+{
+	struct sockaddr_in sin;
+	socklen_t len = sizeof(sin);
+	int s;
+
+	p->source[i].s_addr = INADDR_ANY;
+	s = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+	if (s < 0)
+		return;
+	memset(&sin, 0, sizeof(sin));
+	sin.sin_family = AF_INET;
+	sin.sin_port = htons(1025);
+	sin.sin_addr = p->target[i];
+	if (setsockopt(s, SOL_SOCKET, SO_BINDTODEVICE,
+		       p->name, strlen(p->name) + 1) == 0
+	    && connect(s, (struct sockaddr *)&sin, sizeof(sin)) == 0
+	    && getsockname(s, (struct sockaddr *)&sin, &len) == 0) {
+		p->source[i] = sin.sin_addr;
+	}
+	close(s);
+}
+
+static int arp_open(struct probe_if *p)
+{
+	struct sockaddr_ll sll;
+
+	p->sock = socket(PF_PACKET, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+			 htons(ETH_P_ARP));
+	if (p->sock < 0) {
+		fprintf(stderr, "Failed to open packet socket (%s)\n",
+			strerror(errno));
+		return -1;
+	}
+	memset(&sll, 0, sizeof(sll));
+	sll.sll_family = AF_PACKET;
+	sll.sll_protocol = htons(ETH_P_ARP);
+	sll.sll_ifindex = p->ifindex;
+	if (bind(p->sock, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+		fprintf(stderr, "Failed to bind packet socket to %s (%s)\n",
+			p->name, strerror(errno));
+		close(p->sock);
+		p->sock = -1;
+		return -1;
+	}
+	return 0;
+}
+
+/* broadcast a request for target i, in the layout of send_pack() */
+static void arp_send(struct probe_if *p, int i)
+{
+	unsigned char buf[sizeof(struct arphdr) + 2 * PROBE_HWADDR_LEN + 8];
+	struct arphdr *ah = (struct arphdr *)buf;
+	unsigned char *q = buf + sizeof(*ah);
+	struct sockaddr_ll to;
+
+	ah->ar_hrd = htons(p->type == ARPHRD_FDDI ? ARPHRD_ETHER : p->type);
+	ah->ar_pro = htons(ETH_P_IP);
+	ah->ar_hln = p->hwlen;
+	ah->ar_pln = 4;
+	ah->ar_op = htons(ARPOP_REQUEST);
+	memcpy(q, p->hwaddr, p->hwlen);
+	q += p->hwlen;
+	memcpy(q, &p->source[i], 4);
+	q += 4;
+	memcpy(q, p->brdaddr, p->hwlen);
+	q += p->hwlen;
+	memcpy(q, &p->target[i], 4);
+	q += 4;
+
+	memset(&to, 0, sizeof(to));
+	to.sll_family = AF_PACKET;
+	to.sll_protocol = htons(ETH_P_ARP);
+	to.sll_ifindex = p->ifindex;
+	to.sll_halen = p->hwlen;
+	memcpy(to.sll_addr, p->brdaddr,
+	       p->hwlen < (int)sizeof(to.sll_addr) ? p->hwlen : sizeof(to.sll_addr));
+	if (sendto(p->sock, buf, q - buf, 0, (struct sockaddr *)&to,
+		   sizeof(to)) < 0 && verbose) {
+		fprintf(stderr, "%s: failed to send ARP request (%s)\n",
+			p->name, strerror(errno));
+	}
+}
+
+/* returns 1 if a reply from one of the targets arrived */
+static int arp_recv(struct probe_if *p)
+{
+	unsigned char buf[512];
+	struct arphdr *ah = (struct arphdr *)buf;
+	struct in_addr sip;
+	ssize_t len;
+	int i;
+
+	while ((len = recv(p->sock, buf, sizeof(buf), 0)) >= 0) {
+		if ((size_t)len < sizeof(*ah)
+		    || ah->ar_op != htons(ARPOP_REPLY)
+		    || ah->ar_pro != htons(ETH_P_IP)
+		    || ah->ar_pln != 4 || ah->ar_hln != p->hwlen
+		    || (size_t)len < sizeof(*ah) + 2 * (p->hwlen + 4))
+			continue;
+		memcpy(&sip, buf + sizeof(*ah) + p->hwlen, 4);
+		for (i = 0; i < p->ntargets; i++) {
+			if (sip.s_addr == p->target[i].s_addr)
+				return 1;
+		}
+	}
+	return 0;
+}
+
+/*
+ * ARP the neighbours of all pending interfaces in parallel: count
+ * requests per neighbour (0 for no limit), one per second, until the
+ * first reply or timeout_s seconds from now.
+ */
+static int arp_probe(int fd, unsigned count, unsigned timeout_s, int entries)
+{
+	struct pollfd *pfd;
+	long deadline, next, now, until;
+	unsigned sent = 0;
+	int i, j, n, pending;
+
+	pfd = calloc(nifs, sizeof(*pfd));
+	if (!pfd) {
+		fprintf(stderr, "Failed calloc()\n");
+		return -1;
+	}
+
+	for (i = 0; i < nifs; i++) {
+		ifs[i].sock = -1;
+		if (ifs[i].verdict != PENDING)
+			continue;
+		if ((ifs[i].flags & IFF_NOARP) || ifs[i].hwlen == 0) {
+			set_verdict(&ifs[i], DOWN, "noarp");
+			continue;
+		}
+		if (find_targets(fd, &ifs[i], entries) < 0)
+			goto fail;
+		if (ifs[i].ntargets == 0) {
+			set_verdict(&ifs[i], DOWN, "no-neighbours");
+			continue;
+		}
+		if (arp_open(&ifs[i]) < 0)
+			goto fail;
+	}
+
+	now = now_ms();
+	deadline = now + timeout_s * 1000L;
+	next = now;
+	while (now < deadline) {
+		if (now >= next && (count == 0 || sent < count)) {
+			for (i = 0; i < nifs; i++) {
+				if (ifs[i].sock < 0 || ifs[i].verdict != PENDING)
+					continue;
+				for (j = 0; j < ifs[i].ntargets; j++)
+					arp_send(&ifs[i], j);
+			}
+			sent++;
+			next = now + PROBE_ARP_INTERVAL_MS;
+		}
+
+		n = 0;
+		for (i = 0; i < nifs; i++) {
+			if (ifs[i].sock < 0 || ifs[i].verdict != PENDING)
+				continue;
+			pfd[n].fd = ifs[i].sock;
+			pfd[n].events = POLLIN;
+			n++;
+		}
+		if (n == 0)
+			break;
+		/* with all requests sent, only the deadline is left */
+		until = deadline;
+		if ((count == 0 || sent < count) && next < deadline)
+			until = next;
+		poll(pfd, n, until > now ? (int)(until - now) : 0);
+
+		pending = 0;
+		for (i = 0; i < nifs; i++) {
+			if (ifs[i].sock < 0 || ifs[i].verdict != PENDING)
+				continue;
+			if (arp_recv(&ifs[i]))
+				set_verdict(&ifs[i], UP, "arp");
+			else
+				pending++;
+		}
+		if (!pending)
+			break;
+		now = now_ms();
+	}
+
+	for (i = 0; i < nifs; i++) {
+		if (ifs[i].sock >= 0)
+			close(ifs[i].sock);
+		set_verdict(&ifs[i], DOWN, "noreply");
+	}
+	free(pfd);
+	return 0;
+
+fail:
+	for (i = 0; i < nifs; i++) {
+		if (ifs[i].sock >= 0)
+			close(ifs[i].sock);
+	}
+	free(pfd);
+	return -1;
+}
+
+/* one check of all interfaces, as if_check() in ethmonitor */
+static int probe_round(int qfd, int efd, const struct probe_opts *o)
+{
+	check_links(o->link_only);
+	if (o->pktcnt_timeout)
+		watch_rx(qfd, efd, o->pktcnt_timeout);
+	return arp_probe(qfd, o->arping_count, o->arping_timeout, o->entries);
+}
+
+static int link_lost(const struct probe_if *p)
+{
+	return p->verdict == DOWN && (strcmp(p->reason, "link") == 0
+				      || strcmp(p->reason, "missing") == 0);
+}
+
+/* the published verdicts, for write_state() */
+static void print_state(FILE *f, void *arg)
+{
+	int i;
+
+	(void)arg;
+	for (i = 0; i < nifs; i++) {
+		if (ifs[i].published == PENDING)
+			continue;
+		fprintf(f, "%s %s %s\n", ifs[i].name,
+			ifs[i].published == UP ? "up" : "down",
+			ifs[i].published_reason);
+	}
+}
+
+/* push a changed verdict to the node attribute of the interface */
+static void publish(struct probe_if *p, enum verdict v, const char *reason)
+{
+	char score[32];
+	pid_t pid;
+	int status;
+
+	p->published_reason = reason;
+	if (p->published == v) {
+		return;
+	}
+	p->published = v;
+	syslog(v == UP ? LOG_INFO : LOG_WARNING, "%s is %s (%s)",
+	       p->name, v == UP ? "up" : "down", reason);
+	write_state(daemon_opts->statefile, print_state, NULL);
+
+	if (!p->attr) {
+		return;
+	}
+	snprintf(score, sizeof(score), "%lu", v == UP ? p->multiplier : 0);
+	pid = fork();
+	if (pid == 0) {
+		execlp("attrd_updater", "attrd_updater", "-n", p->attr,
+		       "-v", score, "-q", (char *)NULL);
+		_exit(127);
+	}
+	if (pid < 0 || waitpid(pid, &status, 0) < 0
+	    || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+		syslog(LOG_WARNING, "attrd_updater: could not update %s = %s",
+		       p->attr, score);
+		/* try again with the next verdict */
+		p->published = PENDING;
+	}
+}
+
+/*
+ * Publish the verdict of the last check. A lost link counts at once,
+ * like a reply; anything else only after repeat_count failed checks
+ * in a row, as ethmonitor retries before it gives up.
+ */
+static void report(struct probe_if *p)
+{
+	if (p->verdict == UP || link_lost(p)) {
+		p->fails = 0;
+		publish(p, p->verdict, p->reason);
+	} else if (p->verdict == DOWN
+		   && ++p->fails >= daemon_opts->repeat_count) {
+		publish(p, DOWN, p->reason);
+	}
+}
+
+/*
+ * Sleep until the next round, handling link events. Returns 1 early if
+ * a link came back, so that it is checked right away.
+ */
+static int wait_events(int efd, long until)
+{
+	struct pollfd pfd;
+	long now;
+	int i;
+
+	while ((now = now_ms()) < until) {
+		pfd.fd = efd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, until - now) <= 0)
+			continue;
+		if (rtnl_read(efd, 0, 0, link_msg, NULL) < 0)
+			return -1;
+		for (i = 0; i < nifs; i++) {
+			if (!ifs[i].ifindex || !(ifs[i].flags & IFF_UP)
+			    || !(ifs[i].flags & IFF_RUNNING)) {
+				ifs[i].verdict = PENDING;
+				set_verdict(&ifs[i], DOWN,
+					    ifs[i].ifindex ? "link" : "missing");
+			} else if (ifs[i].published == DOWN
+				   && strcmp(ifs[i].published_reason, "link") == 0) {
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+static int run_daemon(int qfd, int efd, const struct probe_opts *o)
+{
+	long start;
+	int i;
+
+	daemon_opts = o;
+	for (;;) {
+		start = now_ms();
+		for (i = 0; i < nifs; i++)
+			ifs[i].verdict = PENDING;
+		if (link_dump(qfd) < 0 || probe_round(qfd, efd, o) < 0)
+			return -1;
+		for (i = 0; i < nifs; i++) {
+			/* lost links were reported as they went */
+			if (!link_lost(&ifs[i]))
+				report(&ifs[i]);
+		}
+		if (wait_events(efd, start + o->repeat_interval * 1000L) < 0)
+			return -1;
+	}
+}
+
+/*
+ * interface[:attribute[:multiplier]], the multiplier follows the last
+ * ':' so that the attribute may contain some (then it is required)
+ */
+static int parse_spec(struct probe_if *p, char *spec)
+{
+	char *c, *end;
+
+	p->name = spec;
+	p->multiplier = 1;
+	c = strchr(spec, ':');
+	if (!c)
+		return 0;
+	*c++ = 0;
+	p->attr = c;
+	c = strrchr(c, ':');
+	if (!c)
+		return 0;
+	*c++ = 0;
+	p->multiplier = strtoul(c, &end, 10);
+	return (end == c || *end) ? -1 : 0;
+}
+
+static void usage(void)
+{
+	printf("Usage: /usr/lib/heartbeat/ethmonitor_probe [ -l ] [ -t pktcnt_timeout ]\n");
+	printf("            [ -c arping_count ] [ -w arping_timeout ]\n");
+	printf("            [ -e arping_cache_entries ] [ -v ] interface...\n");
+	printf("Prints \"interface up|down reason\" for every interface:\n");
+	printf("  missing, link (no carrier), rx (packets received),\n");
+	printf("  arp (a neighbour answered), noarp, no-neighbours, noreply.\n");
+	printf("Exits with 0 if all are up, 1 if some are down, 2 on errors.\n");
+	printf("\n");
+	printf("       /usr/lib/heartbeat/ethmonitor_probe -d [ -i repeat_interval ]\n");
+	printf("            [ -r repeat_count ] [ -s statefile ] [ check options ]\n");
+	printf("            interface[:attribute[:multiplier]]...\n");
+	printf("Checks every repeat_interval seconds and on link changes, and sets\n");
+	printf("the attribute to multiplier (up) or 0 (down) when the verdict of\n");
+	printf("an interface changes. Runs until killed.\n");
+	exit(PROBE_ERROR);
+}
+
+#define OPTION_STRING "lt:c:w:e:di:r:s:vh"
+
+int main(int argc, char *argv[])
+{
+	int optchar, cont = 1;
+	int daemon_mode = 0;
+	struct probe_opts o;
+	int qfd, efd, i, ret;
+
+	memset(&o, 0, sizeof(o));
+	o.pktcnt_timeout = 5;
+	o.arping_count = 1;
+	o.arping_timeout = 1;
+	o.entries = 5;
+	o.repeat_interval = 10;
+	o.repeat_count = 5;
+
+	while(cont) {
+		optchar = getopt(argc, argv, OPTION_STRING);
+		switch(optchar) {
+		case 'l':
+			o.link_only = 1;
+			break;
+		case 't':
+			o.pktcnt_timeout = strtoul(optarg, NULL, 10);
+			break;
+		case 'c':
+			o.arping_count = strtoul(optarg, NULL, 10);
+			break;
+		case 'w':
+			o.arping_timeout = strtoul(optarg, NULL, 10);
+			break;
+		case 'e':
+			o.entries = strtoul(optarg, NULL, 10);
+			break;
+		case 'd':
+			daemon_mode = 1;
+			break;
+		case 'i':
+			o.repeat_interval = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			o.repeat_count = strtoul(optarg, NULL, 10);
+			break;
+		case 's':
+			o.statefile = optarg;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
+		case 'h':
+			usage();
+			break;
+		case EOF:
+			cont = 0;
+			break;
+		default:
+			fprintf(stderr, "unknown option, please use '-h' for usage.\n");
+			exit(PROBE_ERROR);
+			break;
+		};
+	}
+
+	if (optind >= argc) {
+		usage();
+	}
+	nifs = argc - optind;
+	ifs = calloc(nifs, sizeof(*ifs));
+	if (!ifs) {
+		fprintf(stderr, "Failed calloc()\n");
+		exit(PROBE_ERROR);
+	}
+	for (i = 0; i < nifs; i++) {
+		if (!daemon_mode) {
+			ifs[i].name = argv[optind + i];
+		} else if (parse_spec(&ifs[i], argv[optind + i]) < 0) {
+			fprintf(stderr, "Bad interface %s\n", argv[optind + i]);
+			exit(PROBE_ERROR);
+		}
+	}
+
+	/* subscribe before the first dump, so that no change is missed */
+	efd = rtnl_open(RTMGRP_LINK);
+	qfd = rtnl_open(0);
+	if (qfd < 0 || link_dump(qfd) < 0) {
+		exit(PROBE_ERROR);
+	}
+
+	if (daemon_mode) {
+		if (efd < 0) {
+			exit(PROBE_ERROR);
+		}
+		if (o.repeat_interval == 0)
+			o.repeat_interval = 1;
+		if (o.repeat_count == 0)
+			o.repeat_count = 1;
+		openlog("ethmonitor_probe", LOG_PID, LOG_DAEMON);
+		run_daemon(qfd, efd, &o);
+		exit(PROBE_ERROR);
+	}
+
+	if (probe_round(qfd, efd, &o) < 0) {
+		exit(PROBE_ERROR);
+	}
+
+	ret = PROBE_ALL_UP;
+	for (i = 0; i < nifs; i++) {
+		printf("%s %s %s\n", ifs[i].name,
+		       ifs[i].verdict == UP ? "up" : "down", ifs[i].reason);
+		if (ifs[i].verdict != UP)
+			ret = PROBE_SOME_DOWN;
+	}
+
+	if (efd >= 0)
+		close(efd);
+	close(qfd);
+	free(ifs);
+	return ret;
+}
@@ -0,0 +1,344 @@
+/*
+ * findaddr.c:	Finds the interfaces which hold given IP addresses
+ *
+ *	The counterpart of findif for the IPaddr2 monitor: where that
+ *	asks which interface could serve an address, this one asks which
+ *	interfaces do. All queries on the command line are answered from
+ *	a single RTM_GETADDR dump, so an agent (or a batch of them) does
+ *	not have to run and filter "ip addr show" for every address.
+ *
+ *	Every argument is a query and gets one line of output, the query
+ *	followed by the answer:
+ *
+ *	ip/prefix		the interfaces holding ip/prefix, if any
+ *	ip/prefix@nic		"ok" if nic holds ip/prefix, else "no"
+ *	ip/prefix@nic#bucket	for CLUSTERIP: "no" if no interface holds
+ *				ip/prefix, "partial2" if there is no
+ *				CLUSTERIP rule for ip, "ok" if this node
+ *				serves bucket and "partial" if not
+ *
+ *	which are the answers of find_interface() and ip_served() in
+ *	IPaddr2. IPsec (ipsecN) interfaces are not considered.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110-1301 USA
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#define FINDADDR_BUFSIZE	65536
+#define CLUSTERIP_DIR		"/proc/net/ipt_CLUSTERIP/"
+
+/* one command line argument */
+struct query {
+	char *arg;		/* as given, for the output */
+	char *ip;		/* the address part, for CLUSTERIP */
+	int family;
+	unsigned char addr[16];
+	unsigned prefix;
+	const char *nic;	/* NULL: list the interfaces */
+	long bucket;		/* < 0: not CLUSTERIP */
+
+	/* result */
+	char *ifaces;		/* space separated */
+	size_t ifaces_len;
+	int on_nic;
+};
+
+static int parse_query(struct query *q, const char *arg);
+static int add_iface(struct query *q, const char *name);
+static void addr_msg(struct nlmsghdr *h, struct query *qs, int nq);
+static int addr_dump(struct query *qs, int nq);
+static int is_ipsec(const char *name);
+static const char *cip_status(const struct query *q);
+static void usage(void);
+
+static int parse_query(struct query *q, const char *arg)
+{
+	char *s, *c, *end;
+
+	memset(q, 0, sizeof(*q));
+	q->bucket = -1;
+	q->arg = strdup(arg);
+	s = strdup(arg);
+	if (!q->arg || !s) {
+		fprintf(stderr, "Failed strdup()\n");
+		exit(2);
+	}
+
+	c = strchr(s, '#');
+	if (c) {
+		*c++ = 0;
+		q->bucket = strtol(c, &end, 10);
+		if (end == c || *end || q->bucket < 1)
+			return -1;
+	}
+	c = strchr(s, '@');
+	if (c) {
+		*c++ = 0;
+		if (!*c)
+			return -1;
+		q->nic = c;
+	} else if (q->bucket >= 0) {
+		return -1;
+	}
+	c = strchr(s, '/');
+	if (!c)
+		return -1;
+	*c++ = 0;
+	q->prefix = strtoul(c, &end, 10);
+	if (end == c || *end)
+		return -1;
+	q->ip = s;
+
+	if (inet_pton(AF_INET, s, q->addr) == 1) {
+		q->family = AF_INET;
+		if (q->prefix > 32)
+			return -1;
+	} else if (inet_pton(AF_INET6, s, q->addr) == 1) {
+		q->family = AF_INET6;
+		if (q->prefix > 128 || q->bucket >= 0)
+			return -1;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+static int add_iface(struct query *q, const char *name)
+{
+	size_t len = strlen(name);
+	char *p;
+
+	if (q->nic) {
+		if (strcmp(q->nic, name) == 0)
+			q->on_nic = 1;
+		/* for CLUSTERIP, any interface will do */
+		if (q->bucket >= 0)
+			q->on_nic = 1;
+		return 0;
+	}
+	p = realloc(q->ifaces, q->ifaces_len + len + 2);
+	if (!p) {
+		fprintf(stderr, "Failed realloc()\n");
+		exit(2);
+	}
+	q->ifaces = p;
+	p += q->ifaces_len;
+	*p++ = ' ';
+	memcpy(p, name, len + 1);
+	q->ifaces_len += len + 1;
+	return 0;
+}
+
+static int is_ipsec(const char *name)
+{
+	if (strncmp(name, "ipsec", 5) != 0 || !name[5])
+		return 0;
+	for (name += 5; *name; name++) {
+		if (*name < '0' || *name > '9')
+			return 0;
+	}
+	return 1;
+}
+
+static void addr_msg(struct nlmsghdr *h, struct query *qs, int nq)
+{
+	struct ifaddrmsg *ifa = NLMSG_DATA(h);
+	struct rtattr *rta;
+	int len = IFA_PAYLOAD(h);
+	const unsigned char *addr = NULL, *local = NULL;
+	char name[IF_NAMESIZE];
+	int alen, i;
+
+	if (h->nlmsg_type != RTM_NEWADDR)
+		return;
+	alen = (ifa->ifa_family == AF_INET) ? 4 : 16;
+	for (rta = IFA_RTA(ifa); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if ((int)RTA_PAYLOAD(rta) < alen)
+			continue;
+		if (rta->rta_type == IFA_ADDRESS)
+			addr = RTA_DATA(rta);
+		else if (rta->rta_type == IFA_LOCAL)
+			local = RTA_DATA(rta);
+	}
+	/* IFA_ADDRESS is the peer on point to point links */
+	if (local)
+		addr = local;
+	if (!addr)
+		return;
+
+	name[0] = 0;
+	for (i = 0; i < nq; i++) {
+		if (qs[i].family != ifa->ifa_family
+		    || qs[i].prefix != ifa->ifa_prefixlen
+		    || memcmp(qs[i].addr, addr, alen) != 0)
+			continue;
+		if (!name[0] && !if_indextoname(ifa->ifa_index, name))
+			return;
+		if (is_ipsec(name))
+			return;
+		add_iface(&qs[i], name);
+	}
+}
+
+static int addr_dump(struct query *qs, int nq)
+{
+	struct {
+		struct nlmsghdr nlh;
+		struct ifaddrmsg ifa;
+	} req;
+	char *buf;
+	struct nlmsghdr *h;
+	struct nlmsgerr *err;
+	ssize_t len;
+	int fd;
+
+	fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open rtnetlink (%s)\n", strerror(errno));
+		return -1;
+	}
+	buf = malloc(FINDADDR_BUFSIZE);
+	if (!buf) {
+		fprintf(stderr, "Failed malloc()\n");
+		close(fd);
+		return -1;
+	}
+
+	memset(&req, 0, sizeof(req));
+	req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(req.ifa));
+	req.nlh.nlmsg_type = RTM_GETADDR;
+	req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.nlh.nlmsg_seq = 1;
+	req.ifa.ifa_family = AF_UNSPEC;
+	if (send(fd, &req, req.nlh.nlmsg_len, 0) < 0) {
+		fprintf(stderr, "Failed to send netlink request (%s)\n",
+			strerror(errno));
+		goto fail;
+	}
+
+	for (;;) {
+		len = recv(fd, buf, FINDADDR_BUFSIZE, 0);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "Failed to read rtnetlink (%s)\n",
+				strerror(errno));
+			goto fail;
+		}
+		for (h = (struct nlmsghdr *)buf; NLMSG_OK(h, len);
+		     h = NLMSG_NEXT(h, len)) {
+			if (h->nlmsg_type == NLMSG_DONE)
+				goto done;
+			if (h->nlmsg_type == NLMSG_ERROR) {
+				err = NLMSG_DATA(h);
+				fprintf(stderr, "Address dump failed (%s)\n",
+					strerror(-err->error));
+				goto fail;
+			}
+			addr_msg(h, qs, nq);
+		}
+	}
+
+done:
+	free(buf);
+	close(fd);
+	return 0;
+fail:
+	free(buf);
+	close(fd);
+	return -1;
+}
+
+/* as "egrep (^|,)bucket(,|$)" on the CLUSTERIP proc file */
+static const char *cip_status(const struct query *q)
+{
+	char path[sizeof(CLUSTERIP_DIR) + INET6_ADDRSTRLEN];
+	char line[1024];
+	char *tok, *save = NULL, *s;
+	const char *status = "partial";
+	FILE *f;
+
+	snprintf(path, sizeof(path), "%s%s", CLUSTERIP_DIR, q->ip);
+	f = fopen(path, "r");
+	if (!f)
+		return "partial2";
+	while (fgets(line, sizeof(line), f)) {
+		line[strcspn(line, "\n")] = 0;
+		for (s = line; (tok = strtok_r(s, ",", &save)) != NULL; s = NULL) {
+			if (strtol(tok, NULL, 10) == q->bucket
+			    && strspn(tok, "0123456789") == strlen(tok))
+				status = "ok";
+		}
+	}
+	fclose(f);
+	return status;
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: findaddr ip/prefix[@nic[#bucket]]...\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	struct query *qs;
+	int nq, i;
+
+	if (argc < 2 || argv[1][0] == '-') {
+		usage();
+	}
+	nq = argc - 1;
+	qs = calloc(nq, sizeof(*qs));
+	if (!qs) {
+		fprintf(stderr, "Failed calloc()\n");
+		return 2;
+	}
+	for (i = 0; i < nq; i++) {
+		if (parse_query(&qs[i], argv[i + 1]) < 0) {
+			fprintf(stderr, "Bad query %s\n", argv[i + 1]);
+			return 2;
+		}
+	}
+
+	if (addr_dump(qs, nq) < 0) {
+		return 2;
+	}
+
+	for (i = 0; i < nq; i++) {
+		if (!qs[i].nic)
+			printf("%s%s\n", qs[i].arg, qs[i].ifaces ? qs[i].ifaces : "");
+		else if (!qs[i].on_nic)
+			printf("%s no\n", qs[i].arg);
+		else if (qs[i].bucket >= 0)
+			printf("%s %s\n", qs[i].arg, cip_status(&qs[i]));
+		else
+			printf("%s ok\n", qs[i].arg);
+	}
+	return 0;
+}
@@ -0,0 +1,342 @@
+/*
+ * Building and sending nf_tables netlink batches.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "nft_batch.h"
+
+static void buf_reserve(struct nft_buf *b, size_t len);
+
+static void buf_reserve(struct nft_buf *b, size_t len)
+{
+	char *p;
+	size_t size;
+
+	if (b->len + len <= b->size)
+		return;
+	size = b->size ? b->size : 4096;
+	while (size < b->len + len)
+		size *= 2;
+	p = realloc(b->data, size);
+	if (!p) {
+		fprintf(stderr, "Failed realloc()\n");
+		exit(2);
+	}
+	memset(p + b->size, 0, size - b->size);
+	b->data = p;
+	b->size = size;
+}
+
+size_t nft_msg_begin(struct nft_buf *b, int type, int family, int flags)
+{
+	struct nlmsghdr nlh;
+	struct nfgenmsg nfg;
+	size_t off = b->len;
+
+	buf_reserve(b, NLMSG_HDRLEN + NLMSG_ALIGN(sizeof(nfg)));
+	memset(&nlh, 0, sizeof(nlh));
+	nlh.nlmsg_type = type;
+	nlh.nlmsg_flags = NLM_F_REQUEST | flags;
+	nlh.nlmsg_seq = ++b->seq;
+	memcpy(b->data + b->len, &nlh, sizeof(nlh));
+	b->len += NLMSG_HDRLEN;
+
+	memset(&nfg, 0, sizeof(nfg));
+	nfg.nfgen_family = family;
+	nfg.version = NFNETLINK_V0;
+	if (type == NFNL_MSG_BATCH_BEGIN || type == NFNL_MSG_BATCH_END)
+		nfg.res_id = htons(NFNL_SUBSYS_NFTABLES);
+	memcpy(b->data + b->len, &nfg, sizeof(nfg));
+	b->len += NLMSG_ALIGN(sizeof(nfg));
+
+	if (flags & NLM_F_ACK)
+		b->msgs++;
+	return off;
+}
+
+void nft_msg_end(struct nft_buf *b, size_t off)
+{
+	struct nlmsghdr *nlh = (struct nlmsghdr *)(void *)(b->data + off);
+
+	nlh->nlmsg_len = b->len - off;
+}
+
+void nft_attr_put(struct nft_buf *b, int type, const void *data, size_t len)
+{
+	struct nlattr nla;
+
+	buf_reserve(b, NLA_HDRLEN + NLA_ALIGN(len));
+	nla.nla_type = type;
+	nla.nla_len = NLA_HDRLEN + len;
+	memcpy(b->data + b->len, &nla, sizeof(nla));
+	if (len)
+		memcpy(b->data + b->len + NLA_HDRLEN, data, len);
+	b->len += NLA_HDRLEN + NLA_ALIGN(len);
+}
+
+void nft_attr_put_str(struct nft_buf *b, int type, const char *s)
+{
+	nft_attr_put(b, type, s, strlen(s) + 1);
+}
+
+/* nf_tables wants all integers in network byte order */
+void nft_attr_put_u32(struct nft_buf *b, int type, uint32_t v)
+{
+	v = htonl(v);
+	nft_attr_put(b, type, &v, sizeof(v));
+}
+
+size_t nft_nest_begin(struct nft_buf *b, int type)
+{
+	size_t off = b->len;
+
+	nft_attr_put(b, type | NLA_F_NESTED, NULL, 0);
+	return off;
+}
+
+void nft_nest_end(struct nft_buf *b, size_t off)
+{
+	struct nlattr *nla = (struct nlattr *)(void *)(b->data + off);
+
+	nla->nla_len = b->len - off;
+}
+
+void nft_batch_begin(struct nft_buf *b)
+{
+	nft_msg_end(b, nft_msg_begin(b, NFNL_MSG_BATCH_BEGIN, AF_UNSPEC, 0));
+}
+
+void nft_batch_end(struct nft_buf *b)
+{
+	nft_msg_end(b, nft_msg_begin(b, NFNL_MSG_BATCH_END, AF_UNSPEC, 0));
+}
+
+/* an expression is a list element with a name and nested data */
+void nft_expr_begin(struct nft_buf *b, struct nft_expr *e, const char *name)
+{
+	e->elem = nft_nest_begin(b, NFTA_LIST_ELEM);
+	nft_attr_put_str(b, NFTA_EXPR_NAME, name);
+	e->data = nft_nest_begin(b, NFTA_EXPR_DATA);
+}
+
+void nft_expr_end(struct nft_buf *b, const struct nft_expr *e)
+{
+	nft_nest_end(b, e->data);
+	nft_nest_end(b, e->elem);
+}
+
+void nft_expr_meta(struct nft_buf *b, uint32_t key, uint32_t dreg)
+{
+	struct nft_expr e;
+
+	nft_expr_begin(b, &e, "meta");
+	nft_attr_put_u32(b, NFTA_META_KEY, key);
+	nft_attr_put_u32(b, NFTA_META_DREG, dreg);
+	nft_expr_end(b, &e);
+}
+
+void nft_expr_meta_set(struct nft_buf *b, uint32_t key, uint32_t sreg)
+{
+	struct nft_expr e;
+
+	nft_expr_begin(b, &e, "meta");
+	nft_attr_put_u32(b, NFTA_META_KEY, key);
+	nft_attr_put_u32(b, NFTA_META_SREG, sreg);
+	nft_expr_end(b, &e);
+}
+
+void nft_expr_cmp_eq(struct nft_buf *b, uint32_t sreg,
+		     const void *data, size_t len)
+{
+	struct nft_expr e;
+	size_t d;
+
+	nft_expr_begin(b, &e, "cmp");
+	nft_attr_put_u32(b, NFTA_CMP_SREG, sreg);
+	nft_attr_put_u32(b, NFTA_CMP_OP, NFT_CMP_EQ);
+	d = nft_nest_begin(b, NFTA_CMP_DATA);
+	nft_attr_put(b, NFTA_DATA_VALUE, data, len);
+	nft_nest_end(b, d);
+	nft_expr_end(b, &e);
+}
+
+void nft_expr_payload(struct nft_buf *b, uint32_t base, uint32_t offset,
+		      uint32_t len, uint32_t dreg)
+{
+	struct nft_expr e;
+
+	nft_expr_begin(b, &e, "payload");
+	nft_attr_put_u32(b, NFTA_PAYLOAD_DREG, dreg);
+	nft_attr_put_u32(b, NFTA_PAYLOAD_BASE, base);
+	nft_attr_put_u32(b, NFTA_PAYLOAD_OFFSET, offset);
+	nft_attr_put_u32(b, NFTA_PAYLOAD_LEN, len);
+	nft_expr_end(b, &e);
+}
+
+/* no checksum to fix up */
+void nft_expr_payload_set(struct nft_buf *b, uint32_t base, uint32_t offset,
+			  uint32_t len, uint32_t sreg)
+{
+	struct nft_expr e;
+
+	nft_expr_begin(b, &e, "payload");
+	nft_attr_put_u32(b, NFTA_PAYLOAD_SREG, sreg);
+	nft_attr_put_u32(b, NFTA_PAYLOAD_BASE, base);
+	nft_attr_put_u32(b, NFTA_PAYLOAD_OFFSET, offset);
+	nft_attr_put_u32(b, NFTA_PAYLOAD_LEN, len);
+	nft_attr_put_u32(b, NFTA_PAYLOAD_CSUM_TYPE, NFT_PAYLOAD_CSUM_NONE);
+	nft_expr_end(b, &e);
+}
+
+void nft_expr_immediate(struct nft_buf *b, uint32_t dreg,
+			const void *data, size_t len)
+{
+	struct nft_expr e;
+	size_t d;
+
+	nft_expr_begin(b, &e, "immediate");
+	nft_attr_put_u32(b, NFTA_IMMEDIATE_DREG, dreg);
+	d = nft_nest_begin(b, NFTA_IMMEDIATE_DATA);
+	nft_attr_put(b, NFTA_DATA_VALUE, data, len);
+	nft_nest_end(b, d);
+	nft_expr_end(b, &e);
+}
+
+void nft_expr_lookup(struct nft_buf *b, const char *set, uint32_t id,
+		     uint32_t sreg, uint32_t flags)
+{
+	struct nft_expr e;
+
+	nft_expr_begin(b, &e, "lookup");
+	nft_attr_put_str(b, NFTA_LOOKUP_SET, set);
+	nft_attr_put_u32(b, NFTA_LOOKUP_SET_ID, id);
+	nft_attr_put_u32(b, NFTA_LOOKUP_SREG, sreg);
+	if (flags)
+		nft_attr_put_u32(b, NFTA_LOOKUP_FLAGS, flags);
+	nft_expr_end(b, &e);
+}
+
+void nft_expr_drop(struct nft_buf *b)
+{
+	struct nft_expr e;
+	size_t d, v;
+
+	nft_expr_begin(b, &e, "immediate");
+	nft_attr_put_u32(b, NFTA_IMMEDIATE_DREG, NFT_REG_VERDICT);
+	d = nft_nest_begin(b, NFTA_IMMEDIATE_DATA);
+	v = nft_nest_begin(b, NFTA_DATA_VERDICT);
+	nft_attr_put_u32(b, NFTA_VERDICT_CODE, NF_DROP);
+	nft_nest_end(b, v);
+	nft_nest_end(b, d);
+	nft_expr_end(b, &e);
+}
+
+int nft_open(void)
+{
+	int fd;
+	struct sockaddr_nl snl;
+	struct timeval tv;
+
+	fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_NETFILTER);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open netfilter netlink (%s)\n",
+			strerror(errno));
+		return -1;
+	}
+	/* the kernel answers at once; do not wait forever if it does not */
+	tv.tv_sec = NFT_RECV_TIMEOUT;
+	tv.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	memset(&snl, 0, sizeof(snl));
+	snl.nl_family = AF_NETLINK;
+	if (bind(fd, (struct sockaddr *)&snl, sizeof(snl)) < 0) {
+		fprintf(stderr, "Failed to bind netlink (%s)\n", strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * The kernel handles the batch within send(), so by then all its
+ * answers are queued. That is one ack per message which asked for
+ * it, unless the whole batch is refused (no CAP_NET_ADMIN, nf_tables
+ * missing): then a single error comes for the batch begin message.
+ * So the first error ends the wait, and whatever else came for the
+ * batch is read without waiting, to not confuse the next request.
+ * The receive timeout of nft_open() is the last resort.
+ */
+int nft_talk(int fd, struct nft_buf *b)
+{
+	char rbuf[16384];
+	struct nlmsghdr *h;
+	struct nlmsgerr *err;
+	ssize_t rlen;
+	int sndbuf;
+	int ret = 0;
+	unsigned pending = b->msgs;
+
+	if (b->len > 65536) {
+		sndbuf = b->len + 4096;
+		if (setsockopt(fd, SOL_SOCKET, SO_SNDBUFFORCE,
+			       &sndbuf, sizeof(sndbuf)) < 0) {
+			setsockopt(fd, SOL_SOCKET, SO_SNDBUF,
+				   &sndbuf, sizeof(sndbuf));
+		}
+	}
+
+	if (send(fd, b->data, b->len, 0) < 0) {
+		return -errno;
+	}
+
+	while (pending) {
+		rlen = recv(fd, rbuf, sizeof(rbuf), ret ? MSG_DONTWAIT : 0);
+		if (rlen < 0) {
+			if (errno == EINTR)
+				continue;
+			if (ret)
+				break;
+			ret = (errno == EAGAIN || errno == EWOULDBLOCK)
+				? -ETIMEDOUT : -errno;
+			break;
+		}
+		for (h = (struct nlmsghdr *)(void *)rbuf; NLMSG_OK(h, rlen);
+		     h = NLMSG_NEXT(h, rlen)) {
+			if (h->nlmsg_type != NLMSG_ERROR)
+				continue;
+			err = NLMSG_DATA(h);
+			if (err->error && !ret)
+				ret = err->error;
+			if (pending)
+				pending--;
+		}
+	}
+
+	b->len = 0;
+	b->msgs = 0;
+	return ret;
+}
@@ -0,0 +1,101 @@
+/*
+ * Building and sending nf_tables netlink batches, for the tools which
+ * manage nftables objects without the nft program or libnftnl.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef NFT_BATCH_H
+#define NFT_BATCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/netlink.h>
+#include <linux/netfilter.h>
+#include <linux/netfilter/nfnetlink.h>
+#include <linux/netfilter/nf_tables.h>
+
+/* nft data type ids, for "nft list" to print the set keys */
+#define NFT_TYPE_BITS		6
+#define NFT_TYPE_IPADDR		7
+#define NFT_TYPE_IP6ADDR	8
+#define NFT_TYPE_INET_PROTOCOL	12
+#define NFT_TYPE_INET_SERVICE	13
+#define NFT_TYPE_MARK		19
+
+/* the message type of an nf_tables request */
+#define NFT_MSG(type)		((NFNL_SUBSYS_NFTABLES << 8) | (type))
+
+/* a growing buffer of netlink messages */
+struct nft_buf {
+	char *data;
+	size_t len;
+	size_t size;
+	uint32_t seq;
+	unsigned msgs;		/* messages that will be acked */
+};
+
+/* the two nests of an expression, see nft_expr_begin() */
+struct nft_expr {
+	size_t elem;
+	size_t data;
+};
+
+/*
+ * Messages and attributes. The begin functions return the offset to
+ * pass to the matching end function, which fills in the length.
+ * Running out of memory exits the program with status 2.
+ */
+size_t nft_msg_begin(struct nft_buf *b, int type, int family, int flags);
+void nft_msg_end(struct nft_buf *b, size_t off);
+void nft_attr_put(struct nft_buf *b, int type, const void *data, size_t len);
+void nft_attr_put_str(struct nft_buf *b, int type, const char *s);
+void nft_attr_put_u32(struct nft_buf *b, int type, uint32_t v);
+size_t nft_nest_begin(struct nft_buf *b, int type);
+void nft_nest_end(struct nft_buf *b, size_t off);
+void nft_batch_begin(struct nft_buf *b);
+void nft_batch_end(struct nft_buf *b);
+
+/* rule expressions, to be put in an NFTA_RULE_EXPRESSIONS nest */
+void nft_expr_begin(struct nft_buf *b, struct nft_expr *e, const char *name);
+void nft_expr_end(struct nft_buf *b, const struct nft_expr *e);
+void nft_expr_meta(struct nft_buf *b, uint32_t key, uint32_t dreg);
+void nft_expr_meta_set(struct nft_buf *b, uint32_t key, uint32_t sreg);
+void nft_expr_cmp_eq(struct nft_buf *b, uint32_t sreg,
+		     const void *data, size_t len);
+void nft_expr_payload(struct nft_buf *b, uint32_t base, uint32_t offset,
+		      uint32_t len, uint32_t dreg);
+void nft_expr_payload_set(struct nft_buf *b, uint32_t base, uint32_t offset,
+			  uint32_t len, uint32_t sreg);
+void nft_expr_immediate(struct nft_buf *b, uint32_t dreg,
+			const void *data, size_t len);
+void nft_expr_lookup(struct nft_buf *b, const char *set, uint32_t id,
+		     uint32_t sreg, uint32_t flags);
+void nft_expr_drop(struct nft_buf *b);
+
+/* seconds to wait for an answer of the kernel */
+#define NFT_RECV_TIMEOUT	5
+
+/* the NETLINK_NETFILTER socket, or -1 after printing why not */
+int nft_open(void);
+
+/*
+ * Send the buffer in one go (a batch must be a single datagram) and
+ * wait for one acknowledgement per message that asked for it, or the
+ * first error. Returns 0 or that error as a negative errno (-ETIMEDOUT
+ * if the kernel does not answer), and empties the buffer.
+ */
+int nft_talk(int fd, struct nft_buf *b);
+
+#endif /* NFT_BATCH_H */
@@ -0,0 +1,556 @@
+/*
+ * ocf_holders.c:	Find, and get rid of, the processes which hold a mount
+ *
+ *	The open file scanner of the Filesystem resource agent.
+ *
+ *	"ocf_holders [-d] directory" prints the pids of the processes which
+ *	have their current or root directory, their executable, an open
+ *	file or a mapped file on the directory or below it, one per line.
+ *
+ *	Without -d (force_unmount=safe) it only reads the links and the
+ *	maps under /proc and never stat()s a path, so an unresponsive NFS
+ *	mount cannot block it. With -d (force_unmount=true) it looks for
+ *	files on the device mounted on the directory, wherever they are,
+ *	as "fuser -m" does. Either way it takes one pass over /proc, and
+ *	the maps of a process are only read if nothing else matched.
+ *	Processes in another mount namespace see paths of their own and
+ *	are found by path only if those are the same as ours.
+ *
+ *	"ocf_holders -u msecs [-d] [-n] directory command..." unmounts the
+ *	directory with the command (umount and its options). While the
+ *	directory is still mounted it sends SIGTERM to the holders, waits
+ *	for them to exit with pidfd_open and poll, and runs the command
+ *	again as soon as the last one is gone, or after a second at most.
+ *	It sends SIGKILL from half of msecs on and gives up at msecs. With
+ *	-n it only tries the command again, once a second. What it does is
+ *	told on stdout, for the agent to log. It exits with 0 if the
+ *	directory got unmounted, 1 if not and 2 on errors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <errno.h>
+#include <limits.h>
+#include <signal.h>
+#include <time.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+#include "ocf_util.h"
+
+#define PROC_DIR	"/proc"
+#define MOUNTINFO	"/proc/self/mountinfo"
+#define DELETED		" (deleted)"
+
+#define HOLDERS_OK	0
+#define HOLDERS_MOUNTED	1
+#define HOLDERS_ERROR	2
+
+#define RETRY_MS	1000	/* when there is nothing to wait for */
+
+struct pids {
+	pid_t *pid;
+	size_t n, size;
+};
+
+static const char *dir;		/* without trailing slashes */
+static size_t dirlen;
+static int by_dev;		/* -d, match the device instead of paths */
+static dev_t dev;
+
+static int under(const char *path);
+static int link_holds(int dfd, const char *name);
+static int fds_hold(int pfd);
+static int maps_hold(int pfd);
+static int holds(int pfd);
+static int scan(struct pids *pids);
+static void unescape(char *s);
+static int find_mount(dev_t *devp);
+static int run_command(char **argv);
+static void describe(pid_t pid, char *buf, size_t len);
+static int gone(pid_t pid);
+static void wait_gone(const struct pids *pids, long until);
+static int unmount(char **cmd, long msecs, int signals);
+static void usage(void);
+
+/* path is dir or below it, maybe a deleted file */
+static int under(const char *path)
+{
+	if (strncmp(path, dir, dirlen) != 0)
+		return 0;
+	path += dirlen;
+	return *path == 0 || *path == '/' || strcmp(path, DELETED) == 0;
+}
+
+static int link_holds(int dfd, const char *name)
+{
+	char path[PATH_MAX + sizeof(DELETED)];
+	struct stat st;
+	ssize_t n;
+
+	if (by_dev)
+		return fstatat(dfd, name, &st, 0) == 0 && st.st_dev == dev;
+	n = readlinkat(dfd, name, path, sizeof(path) - 1);
+	if (n < 0)
+		return 0;
+	path[n] = 0;
+	return under(path);
+}
+
+static int fds_hold(int pfd)
+{
+	DIR *d;
+	struct dirent *de;
+	int fd, found = 0;
+
+	fd = openat(pfd, "fd", O_RDONLY | O_DIRECTORY);
+	if (fd < 0)
+		return 0;
+	d = fdopendir(fd);
+	if (!d) {
+		close(fd);
+		return 0;
+	}
+	while (!found && (de = readdir(d)) != NULL) {
+		if (de->d_name[0] != '.')
+			found = link_holds(dirfd(d), de->d_name);
+	}
+	closedir(d);
+	return found;
+}
+
+/*
+ * A line of maps is "address perms offset major:minor inode path",
+ * the device in hex.
+ */
+static int maps_hold(int pfd)
+{
+	char line[PATH_MAX + 256];
+	char *p, *nl;
+	unsigned int major, minor;
+	FILE *f;
+	int fd, i, found = 0;
+
+	fd = openat(pfd, "maps", O_RDONLY);
+	if (fd < 0)
+		return 0;
+	f = fdopen(fd, "r");
+	if (!f) {
+		close(fd);
+		return 0;
+	}
+	while (!found && fgets(line, sizeof(line), f)) {
+		p = line;
+		for (i = 0; i < 5; i++) {
+			if (i == 3 && by_dev) {
+				if (sscanf(p, "%x:%x", &major, &minor) == 2
+				    && makedev(major, minor) == dev)
+					found = 1;
+				break;
+			}
+			while (*p && !isspace((unsigned char)*p))
+				p++;
+			while (*p == ' ' || *p == '\t')
+				p++;
+		}
+		if (by_dev || *p != '/')
+			continue;
+		nl = strchr(p, '\n');
+		if (nl)
+			*nl = 0;
+		found = under(p);
+	}
+	fclose(f);
+	return found;
+}
+
+static int holds(int pfd)
+{
+	return link_holds(pfd, "cwd") || link_holds(pfd, "root")
+		|| link_holds(pfd, "exe") || fds_hold(pfd)
+		|| maps_hold(pfd);
+}
+
+static int scan(struct pids *pids)
+{
+	DIR *proc;
+	struct dirent *de;
+	pid_t pid, self;
+	pid_t *p;
+	int pfd;
+
+	proc = opendir(PROC_DIR);
+	if (!proc) {
+		perror(PROC_DIR);
+		return -1;
+	}
+	self = getpid();
+	pids->n = 0;
+	while ((de = readdir(proc)) != NULL) {
+		if (!isdigit((unsigned char)de->d_name[0]))
+			continue;
+		pid = (pid_t)atol(de->d_name);
+		if (pid == self)
+			continue;
+		pfd = openat(dirfd(proc), de->d_name, O_RDONLY | O_DIRECTORY);
+		if (pfd < 0)
+			continue;
+		if (holds(pfd)) {
+			if (pids->n == pids->size) {
+				pids->size = pids->size ? 2 * pids->size : 64;
+				p = realloc(pids->pid, pids->size * sizeof(*p));
+				if (!p) {
+					close(pfd);
+					closedir(proc);
+					return -1;
+				}
+				pids->pid = p;
+			}
+			pids->pid[pids->n++] = pid;
+		}
+		close(pfd);
+	}
+	closedir(proc);
+	return 0;
+}
+
+/* mount points in mountinfo have blanks and backslashes in octal */
+static void unescape(char *s)
+{
+	char *d = s;
+
+	while (*s) {
+		if (s[0] == '\\' && s[1] >= '0' && s[1] <= '3'
+		    && s[2] >= '0' && s[2] <= '7' && s[3] >= '0' && s[3] <= '7') {
+			*d++ = (char)((s[1] - '0') * 64 + (s[2] - '0') * 8 + s[3] - '0');
+			s += 4;
+		} else {
+			*d++ = *s++;
+		}
+	}
+	*d = 0;
+}
+
+/*
+ * Is dir a mount point, and of which device. With mounts stacked on
+ * it, the last one is on top.
+ */
+static int find_mount(dev_t *devp)
+{
+	char line[2 * PATH_MAX + 512];
+	char mnt[PATH_MAX + 1];
+	unsigned int major, minor;
+	FILE *f;
+	int found = 0;
+
+	f = fopen(MOUNTINFO, "r");
+	if (!f) {
+		perror(MOUNTINFO);
+		return -1;
+	}
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%*d %*d %u:%u %*s %4096s", &major, &minor, mnt) != 3)
+			continue;
+		unescape(mnt);
+		if (strcmp(mnt, dir) == 0) {
+			found = 1;
+			if (devp)
+				*devp = makedev(major, minor);
+		}
+	}
+	fclose(f);
+	return found;
+}
+
+static int run_command(char **argv)
+{
+	pid_t pid;
+	int status;
+
+	fflush(stdout);
+	pid = fork();
+	if (pid < 0) {
+		perror("fork");
+		return -1;
+	}
+	if (pid == 0) {
+		execvp(argv[0], argv);
+		perror(argv[0]);
+		_exit(127);
+	}
+	while (waitpid(pid, &status, 0) < 0) {
+		if (errno != EINTR)
+			return -1;
+	}
+	return status;
+}
+
+static void describe(pid_t pid, char *buf, size_t len)
+{
+	char path[64];
+	ssize_t n, i;
+	int fd;
+
+	buf[0] = 0;
+	snprintf(path, sizeof(path), PROC_DIR "/%ld/cmdline", (long)pid);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return;
+	n = read(fd, buf, len - 1);
+	close(fd);
+	if (n <= 0) {
+		buf[0] = 0;
+		return;
+	}
+	for (i = 0; i < n; i++) {
+		if (buf[i] == 0 || buf[i] == '\n')
+			buf[i] = ' ';
+	}
+	while (n > 0 && buf[n - 1] == ' ')
+		n--;
+	buf[n] = 0;
+}
+
+/* a zombie holds nothing anymore */
+static int gone(pid_t pid)
+{
+	char path[64], stat[512];
+	char *p;
+	ssize_t n;
+	int fd;
+
+	snprintf(path, sizeof(path), PROC_DIR "/%ld/stat", (long)pid);
+	fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return 1;
+	n = read(fd, stat, sizeof(stat) - 1);
+	close(fd);
+	if (n <= 0)
+		return 1;
+	stat[n] = 0;
+	p = strrchr(stat, ')');
+	return p && (p[2] == 'Z' || p[2] == 'X');
+}
+
+/*
+ * Wait until all pids exited or until comes. A pidfd polls readable
+ * when its process exits. Without pidfd_open (before Linux 5.3) look
+ * at the processes every 20 ms.
+ */
+static void wait_gone(const struct pids *pids, long until)
+{
+	struct pollfd *pfd;
+	struct timespec ts;
+	pid_t *pid;
+	size_t i, left;
+	long ms;
+	int fd, ret, use_pidfd = 1;
+
+	pfd = calloc(pids->n, sizeof(*pfd));
+	pid = calloc(pids->n, sizeof(*pid));
+	if (!pfd || !pid)
+		goto out;
+	left = 0;
+	for (i = 0; i < pids->n; i++) {
+		if (gone(pids->pid[i]))
+			continue;
+		fd = -1;
+#ifdef SYS_pidfd_open
+		if (use_pidfd)
+			fd = (int)syscall(SYS_pidfd_open, pids->pid[i], 0);
+#endif
+		if (fd < 0)
+			use_pidfd = 0;
+		pfd[left].fd = fd;
+		pfd[left].events = POLLIN;
+		pid[left] = pids->pid[i];
+		left++;
+	}
+	for (i = 0; !use_pidfd && i < left; i++) {
+		if (pfd[i].fd >= 0)
+			close(pfd[i].fd);
+	}
+
+	while (left && (ms = until - now_ms()) > 0) {
+		if (!use_pidfd) {
+			for (i = 0; i < left; ) {
+				if (gone(pid[i])) {
+					pid[i] = pid[--left];
+				} else {
+					i++;
+				}
+			}
+			ts.tv_sec = 0;
+			ts.tv_nsec = (ms < 20 ? ms : 20) * 1000000L;
+			if (left)
+				nanosleep(&ts, NULL);
+			continue;
+		}
+		ret = poll(pfd, left, (int)ms);
+		if (ret < 0 && errno != EINTR)
+			break;
+		for (i = 0; ret > 0 && i < left; ) {
+			if (pfd[i].revents) {
+				close(pfd[i].fd);
+				pfd[i] = pfd[--left];
+				ret--;
+			} else {
+				i++;
+			}
+		}
+	}
+	for (i = 0; use_pidfd && i < left; i++)
+		close(pfd[i].fd);
+out:
+	free(pfd);
+	free(pid);
+}
+
+static int unmount(char **cmd, long msecs, int signals)
+{
+	static char desc[256];
+	struct pids pids = { NULL, 0, 0 };
+	long start, kill_at, deadline, until, now;
+	const char *signame;
+	size_t i;
+	int sig, mounted;
+
+	start = now_ms();
+	kill_at = start + msecs / 2;
+	deadline = start + msecs;
+	for (;;) {
+		run_command(cmd);
+		mounted = find_mount(NULL);
+		if (mounted < 0)
+			return HOLDERS_ERROR;
+		if (!mounted) {
+			printf("unmounted %s successfully\n", dir);
+			return HOLDERS_OK;
+		}
+		now = now_ms();
+		if (now >= deadline)
+			break;
+		sig = now >= kill_at ? SIGKILL : SIGTERM;
+		signame = sig == SIGKILL ? "KILL" : "TERM";
+		printf("Couldn't unmount %s; trying cleanup with %s\n", dir, signame);
+
+		pids.n = 0;
+		if (signals) {
+			if (by_dev && find_mount(&dev) != 1)
+				continue;
+			if (scan(&pids) < 0)
+				return HOLDERS_ERROR;
+			if (pids.n == 0)
+				printf("No processes on %s were signalled\n", dir);
+		}
+		for (i = 0; i < pids.n; i++) {
+			describe(pids.pid[i], desc, sizeof(desc));
+			printf("sending signal %s to: %ld %s\n", signame,
+			       (long)pids.pid[i], desc);
+			kill(pids.pid[i], sig);
+		}
+
+		/*
+		 * Until the holders are gone, at most a second (there may be
+		 * other reasons for the mount to be busy), and no later than
+		 * the time to switch to SIGKILL or give up.
+		 */
+		until = now_ms() + RETRY_MS;
+		if (sig == SIGTERM && until > kill_at)
+			until = kill_at;
+		if (until > deadline)
+			until = deadline;
+		fflush(stdout);
+		if (pids.n)
+			wait_gone(&pids, until);
+		else
+			while ((now = now_ms()) < until)
+				poll(NULL, 0, (int)(until - now));
+	}
+	free(pids.pid);
+	return HOLDERS_MOUNTED;
+}
+
+static void usage(void)
+{
+	printf("Usage: /usr/lib/heartbeat/ocf_holders [-d] directory\n");
+	printf("       /usr/lib/heartbeat/ocf_holders -u msecs [-d] [-n] directory command...\n");
+	printf("Prints the pids of the processes which use files on the\n");
+	printf("directory or below it, or on its device with -d.\n");
+	printf("With -u, unmounts the directory with the command within msecs,\n");
+	printf("sending TERM and then KILL to the processes, unless -n.\n");
+	exit(HOLDERS_ERROR);
+}
+
+int main(int argc, char *argv[])
+{
+	struct pids pids = { NULL, 0, 0 };
+	long msecs = -1;
+	int signals = 1;
+	char *d;
+	size_t i;
+	int c;
+
+	while ((c = getopt(argc, argv, "+u:dnh")) != -1) {
+		switch (c) {
+		case 'u':
+			msecs = strtol(optarg, NULL, 10);
+			break;
+		case 'd':
+			by_dev = 1;
+			break;
+		case 'n':
+			signals = 0;
+			break;
+		default:
+			usage();
+		}
+	}
+	if (optind >= argc || argv[optind][0] != '/')
+		usage();
+	if (msecs < 0 ? optind + 1 != argc : optind + 1 == argc)
+		usage();
+
+	d = argv[optind];
+	dirlen = strlen(d);
+	while (dirlen > 1 && d[dirlen - 1] == '/')
+		d[--dirlen] = 0;
+	dir = d;
+
+	if (msecs >= 0)
+		return unmount(argv + optind + 1, msecs, signals);
+
+	if (by_dev && find_mount(&dev) != 1) {
+		fprintf(stderr, "%s is not mounted\n", dir);
+		return HOLDERS_ERROR;
+	}
+	if (scan(&pids) < 0)
+		return HOLDERS_ERROR;
+	for (i = 0; i < pids.n; i++)
+		printf("%ld\n", (long)pids.pid[i]);
+	free(pids.pid);
+	return HOLDERS_OK;
+}
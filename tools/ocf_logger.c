@@ -0,0 +1,232 @@
+/*
+ * ocf_logger.c:	Send the log messages of a resource agent to syslog
+ *
+ *	ocf-shellfuncs starts it when an action which starts nothing
+ *	(monitor, meta-data, ...) logs to syslog for the first time and
+ *	then writes all messages of the action to its stdin, instead of
+ *	running logger(1) for every one of them.
+ *	A message is "level text" terminated by a NUL character, where
+ *	level is one of crit, err, warning, notice, info and debug.
+ *
+ *	With -r N at most N messages a second are logged. Errors and
+ *	warnings are always logged, and the number of dropped messages
+ *	is logged when the next second begins.
+ *
+ *	It takes the facility names of logger(1), in any case, or a
+ *	number. Bad options are ignored (the facility is then daemon):
+ *	exiting early would only make the writes of the agent fail.
+ *
+ *	It exits at the end of its input, that is when the agent is
+ *	gone; daemons started meanwhile close the pipe first
+ *	(ocf_close_logger).
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <strings.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <syslog.h>
+
+#define LOGGER_BUF	65536
+
+struct code {
+	const char *name;
+	int value;
+};
+
+static const struct code facilities[] = {
+	{ "auth", LOG_AUTH }, { "authpriv", LOG_AUTHPRIV },
+	{ "cron", LOG_CRON }, { "daemon", LOG_DAEMON },
+	{ "kern", LOG_KERN }, { "lpr", LOG_LPR }, { "mail", LOG_MAIL },
+	{ "news", LOG_NEWS }, { "syslog", LOG_SYSLOG }, { "user", LOG_USER },
+	{ "uucp", LOG_UUCP }, { "local0", LOG_LOCAL0 },
+	{ "local1", LOG_LOCAL1 }, { "local2", LOG_LOCAL2 },
+	{ "local3", LOG_LOCAL3 }, { "local4", LOG_LOCAL4 },
+	{ "local5", LOG_LOCAL5 }, { "local6", LOG_LOCAL6 },
+	{ "local7", LOG_LOCAL7 }, { NULL, 0 }
+};
+
+static const struct code levels[] = {
+	{ "crit", LOG_CRIT }, { "err", LOG_ERR }, { "warning", LOG_WARNING },
+	{ "notice", LOG_NOTICE }, { "info", LOG_INFO }, { "debug", LOG_DEBUG },
+	{ NULL, 0 }
+};
+
+static unsigned long rate;	/* messages a second, 0 for no limit */
+static unsigned long sent, dropped;
+static time_t second;
+
+static int lookup(const struct code *table, const char *name);
+static int lookup_facility(const char *name);
+static void flush_dropped(void);
+static void log_record(char *rec);
+static void usage(void);
+
+/* in any case, like logger(1) */
+static int lookup(const struct code *table, const char *name)
+{
+	int i;
+
+	for (i = 0; table[i].name; i++) {
+		if (strcasecmp(table[i].name, name) == 0)
+			return table[i].value;
+	}
+	return -1;
+}
+
+/* a name or, like logger(1), the number of the facility */
+static int lookup_facility(const char *name)
+{
+	char *end;
+	long n;
+
+	n = strtol(name, &end, 10);
+	if (end != name && *end == 0)
+		return (n >= 0 && !(n & ~LOG_FACMASK)) ? (int)n : -1;
+	return lookup(facilities, name);
+}
+
+static void flush_dropped(void)
+{
+	if (dropped) {
+		syslog(LOG_WARNING, "%lu messages dropped, more than %lu a second",
+		       dropped, rate);
+	}
+	dropped = 0;
+}
+
+static void log_record(char *rec)
+{
+	char *msg;
+	int level = -1;
+	time_t now;
+
+	msg = strchr(rec, ' ');
+	if (msg) {
+		*msg = 0;
+		level = lookup(levels, rec);
+		*msg++ = ' ';
+	}
+	if (level < 0) {
+		/* not from ocf-shellfuncs, log it as it is */
+		level = LOG_NOTICE;
+		msg = rec;
+	}
+	if (rate) {
+		now = time(NULL);
+		if (now != second) {
+			flush_dropped();
+			second = now;
+			sent = 0;
+		}
+		if (sent >= rate && level > LOG_WARNING) {
+			dropped++;
+			return;
+		}
+		sent++;
+	}
+	syslog(level, "%s", msg);
+}
+
+static void usage(void)
+{
+	printf("Usage: /usr/lib/heartbeat/ocf_logger [-t tag] [-p facility] [-r rate]\n");
+	printf("Logs the NUL terminated \"level message\" records on stdin\n");
+	printf("to syslog, at most rate (if not 0) a second.\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	static char buf[LOGGER_BUF];
+	const char *tag = "ocf_logger";
+	int facility = LOG_DAEMON;
+	size_t len = 0;
+	char *rec, *end;
+	ssize_t n;
+	long fd, max;
+	int c;
+
+	while ((c = getopt(argc, argv, "t:p:r:h")) != -1) {
+		switch (c) {
+		case 't':
+			tag = optarg;
+			break;
+		case 'p':
+			facility = lookup_facility(optarg);
+			if (facility < 0) {
+				fprintf(stderr, "Unknown facility %s, using daemon\n",
+					optarg);
+				facility = LOG_DAEMON;
+			}
+			break;
+		case 'r':
+			rate = strtoul(optarg, NULL, 10);
+			break;
+		case 'h':
+			usage();
+			break;
+		default:
+			/* the agent writes to us anyway */
+			break;
+		}
+	}
+
+	/* lock files and such of the agent are none of our business */
+	max = sysconf(_SC_OPEN_MAX);
+	if (max < 0 || max > 65536) {
+		max = 65536;
+	}
+	for (fd = 3; fd < max; fd++) {
+		close(fd);
+	}
+	openlog(tag, 0, facility);
+
+	for (;;) {
+		n = read(STDIN_FILENO, buf + len, sizeof(buf) - len - 1);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		len += n;
+		buf[len] = 0;
+
+		rec = buf;
+		while ((end = memchr(rec, 0, buf + len - rec)) != NULL) {
+			if (*rec)
+				log_record(rec);
+			rec = end + 1;
+		}
+		len -= rec - buf;
+		memmove(buf, rec, len);
+		if (len == sizeof(buf) - 1) {
+			/* no message is that long */
+			log_record(buf);
+			len = 0;
+		}
+	}
+	if (len) {
+		buf[len] = 0;
+		log_record(buf);
+	}
+	flush_dropped();
+	closelog();
+	return 0;
+}
@@ -0,0 +1,936 @@
+/*
+ * ocf_rahost.c:	A host for shell resource agents
+ *
+ *	Every action of a shell agent starts a shell which loads
+ *	ocf-shellfuncs before the agent does any work, and that costs
+ *	more than most monitors. ocf_rahost -d keeps one bash per agent
+ *	(see heartbeat/ocf-rahost) which has loaded the library already
+ *	and runs each action in a forked job.
+ *
+ *	The client side is this same program. Run as
+ *
+ *		ocf_rahost agent action
+ *
+ *	or through a symlink named after the agent, for instance
+ *	$OCF_ROOT/resource.d/rahost/IPaddr2 -> ocf_rahost, which runs
+ *	the agent of that name of the heartbeat provider (or of
+ *	$OCF_RAHOST_PROVIDER), it passes its environment and the action to
+ *	the host and then prints what the agent printed and exits with
+ *	its exit code. When there is no host, or the agent is not a shell
+ *	script, it runs the agent itself, so the symlinks can stay when
+ *	the host is stopped.
+ *
+ *	The socket is $OCF_RAHOST_SOCKET or $HA_RSCTMP/ocf_rahost.sock.
+ *	The host runs in the foreground and only serves clients with its
+ *	own uid. If the client goes away, say after a timeout, the action
+ *	is killed with all its processes.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <limits.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <poll.h>
+#include <signal.h>
+#include <syslog.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#define RAHOST_SOCKET		"ocf_rahost.sock"
+#define RAHOST_SHELL		"/bin/bash"
+#define RAHOST_MAX_REQUEST	(1024 * 1024)
+#define RAHOST_MAX_CLIENTS	256
+
+/* what a client gets when its action could not run to the end */
+#define OCF_ERR_GENERIC		1
+
+extern char **environ;
+
+/* one bash with ocf-shellfuncs loaded, for one agent */
+struct zygote {
+	char *agent;
+	pid_t pid;
+	int cmd_fd;		/* requests, -1 once retired */
+	int st_fd;		/* "pid" and "done" lines */
+	char st_buf[4096];
+	size_t st_len;
+	int idx;		/* in the poll set, -1 if not yet */
+	struct zygote *next;
+};
+
+/* one client connection and its action */
+struct request {
+	unsigned id;
+	int fd;			/* -1 after the client went away */
+	char *in;
+	size_t in_len;
+	size_t in_size;
+	struct zygote *z;	/* NULL until it runs */
+	pid_t pid;		/* of the job, 0 until known */
+	int idx;		/* in the poll set, -1 if not yet */
+	struct request *next;
+};
+
+static const char *functions_dir;
+static char workdir[PATH_MAX];
+static time_t functions_mtime;
+static struct zygote *zygotes;
+static struct request *requests;
+static unsigned next_id;
+
+static const char *rsctmp(void);
+static const char *socket_path(void);
+static int is_shell_agent(const char *agent);
+static void run_agent(char *agent, char **argv);
+static int write_all(int fd, const char *buf, size_t len);
+static int client(char *agent, char **argv);
+static void append(char **buf, size_t *len, size_t *size,
+		   const char *data, size_t n);
+static void append_quoted(char **buf, size_t *len, size_t *size,
+			  const char *s, size_t n);
+static int env_ok(const char *name, size_t n);
+static void out_path(char *path, size_t size, unsigned id, const char *ext);
+static int functions_changed(void);
+static void retire(struct zygote *z);
+static struct zygote *find_zygote(const char *agent);
+static struct zygote *spawn_zygote(const char *agent);
+static void reply(struct request *r, int rc, const char *msg);
+static void free_request(struct request *r);
+static void kill_job(pid_t pid);
+static int dispatch(struct request *r);
+static void client_input(struct request *r);
+static struct request *find_request(unsigned id);
+static void zygote_line(struct zygote *z, char *line);
+static void zygote_input(struct zygote *z);
+static void new_client(int lfd);
+static int host(void);
+static void usage(void);
+
+/* where the agents keep their state, as in ocf-directories */
+static const char *rsctmp(void)
+{
+	const char *s = getenv("HA_RSCTMP");
+
+	return (s && *s) ? s : HA_RSCTMPDIR;
+}
+
+static const char *socket_path(void)
+{
+	static char path[PATH_MAX];
+	const char *s = getenv("OCF_RAHOST_SOCKET");
+
+	if (s && *s)
+		return s;
+	snprintf(path, sizeof(path), "%s/%s", rsctmp(), RAHOST_SOCKET);
+	return path;
+}
+
+/* only shell scripts can run in the host */
+static int is_shell_agent(const char *agent)
+{
+	char line[32];
+	int fd, n;
+
+	fd = open(agent, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return 0;
+	n = read(fd, line, sizeof(line) - 1);
+	close(fd);
+	if (n <= 0)
+		return 0;
+	line[n] = 0;
+	line[strcspn(line, " \t\n")] = 0;
+	return strcmp(line, "#!/bin/sh") == 0 || strcmp(line, "#!/bin/bash") == 0;
+}
+
+/* exec the agent, with our argv */
+static void run_agent(char *agent, char **argv)
+{
+	argv[0] = agent;
+	execv(agent, argv);
+	fprintf(stderr, "ocf_rahost: cannot run %s: %s\n", agent, strerror(errno));
+	exit(5);	/* OCF_ERR_INSTALLED */
+}
+
+static int write_all(int fd, const char *buf, size_t len)
+{
+	ssize_t n;
+
+	while (len) {
+		n = write(fd, buf, len);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return -1;
+		}
+		buf += n;
+		len -= n;
+	}
+	return 0;
+}
+
+/*
+ * Send "agent\0action\0NAME=VALUE\0...\0" and get back
+ * "rc outlen errlen\n" with the output.
+ */
+static int client(char *agent, char **argv)
+{
+	struct sockaddr_un sun;
+	char *msg = NULL, *resp = NULL, *p;
+	const char *action = argv[1] ? argv[1] : "";
+	size_t len = 0, size = 0, rlen = 0, rsize = 0;
+	unsigned long rc, olen, elen;
+	char **e;
+	ssize_t n;
+	int fd;
+
+	if (!is_shell_agent(agent)) {
+		run_agent(agent, argv);
+	}
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	if (strlen(socket_path()) >= sizeof(sun.sun_path)) {
+		run_agent(agent, argv);
+	}
+	strcpy(sun.sun_path, socket_path());
+	fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr *)&sun, sizeof(sun)) < 0) {
+		/* no host */
+		run_agent(agent, argv);
+	}
+
+	append(&msg, &len, &size, agent, strlen(agent) + 1);
+	append(&msg, &len, &size, action, strlen(action) + 1);
+	for (e = environ; *e; e++) {
+		if (**e)
+			append(&msg, &len, &size, *e, strlen(*e) + 1);
+	}
+	append(&msg, &len, &size, "", 1);
+	/* nothing runs before the request is complete */
+	if (write_all(fd, msg, len) < 0) {
+		close(fd);
+		run_agent(agent, argv);
+	}
+
+	for (;;) {
+		if (rsize - rlen < 4096) {
+			rsize = rsize ? rsize * 2 : 65536;
+			resp = realloc(resp, rsize);
+			if (!resp) {
+				fprintf(stderr, "Failed realloc()\n");
+				return OCF_ERR_GENERIC;
+			}
+		}
+		n = read(fd, resp + rlen, rsize - rlen - 1);
+		if (n < 0 && errno == EINTR)
+			continue;
+		if (n <= 0)
+			break;
+		rlen += n;
+	}
+	resp[rlen] = 0;
+	p = memchr(resp, '\n', rlen);
+	if (!p || sscanf(resp, "%lu %lu %lu", &rc, &olen, &elen) != 3
+	    || (size_t)(p + 1 - resp) + olen + elen != rlen) {
+		fprintf(stderr, "ocf_rahost: lost the host while running %s\n", agent);
+		return OCF_ERR_GENERIC;
+	}
+	p++;
+	write_all(STDOUT_FILENO, p, olen);
+	write_all(STDERR_FILENO, p + olen, elen);
+	return rc;
+}
+
+static void append(char **buf, size_t *len, size_t *size,
+		   const char *data, size_t n)
+{
+	char *p;
+
+	if (*len + n > *size) {
+		*size = (*len + n) * 2 + 4096;
+		p = realloc(*buf, *size);
+		if (!p) {
+			syslog(LOG_ERR, "out of memory");
+			exit(2);
+		}
+		*buf = p;
+	}
+	memcpy(*buf + *len, data, n);
+	*len += n;
+}
+
+/* in single quotes for the shell */
+static void append_quoted(char **buf, size_t *len, size_t *size,
+			  const char *s, size_t n)
+{
+	const char *q;
+
+	append(buf, len, size, "'", 1);
+	while ((q = memchr(s, '\'', n)) != NULL) {
+		append(buf, len, size, s, q - s);
+		append(buf, len, size, "'\\''", 4);
+		n -= q - s + 1;
+		s = q + 1;
+	}
+	append(buf, len, size, s, n);
+	append(buf, len, size, "'", 1);
+}
+
+/* names bash lets us export, and not our own */
+static int env_ok(const char *name, size_t n)
+{
+	static const char *skip[] = {
+		"BASHOPTS", "EUID", "PPID", "SHELLOPTS", "UID", "_", NULL
+	};
+	size_t i;
+
+	if (n == 0 || (name[0] >= '0' && name[0] <= '9'))
+		return 0;
+	for (i = 0; i < n; i++) {
+		if (!(name[i] == '_' || (name[i] >= 'a' && name[i] <= 'z')
+		      || (name[i] >= 'A' && name[i] <= 'Z')
+		      || (name[i] >= '0' && name[i] <= '9')))
+			return 0;
+	}
+	if ((n > 5 && strncmp(name, "BASH_", 5) == 0)
+	    || (n > 8 && strncmp(name, "__rahost", 8) == 0)
+	    || (n > 10 && strncmp(name, "__OCF_RAHO", 10) == 0))
+		return 0;
+	for (i = 0; skip[i]; i++) {
+		if (strlen(skip[i]) == n && strncmp(name, skip[i], n) == 0)
+			return 0;
+	}
+	return 1;
+}
+
+static void out_path(char *path, size_t size, unsigned id, const char *ext)
+{
+	snprintf(path, size, "%s/%u.%s", workdir, id, ext);
+}
+
+/* an update of the library makes us start new interpreters */
+static int functions_changed(void)
+{
+	char path[PATH_MAX];
+	struct stat st;
+
+	snprintf(path, sizeof(path), "%s/ocf-shellfuncs", functions_dir);
+	if (stat(path, &st) < 0 || st.st_mtime == functions_mtime)
+		return 0;
+	functions_mtime = st.st_mtime;
+	return 1;
+}
+
+/* no more requests: it exits when its last job is done */
+static void retire(struct zygote *z)
+{
+	if (z->cmd_fd >= 0) {
+		close(z->cmd_fd);
+		z->cmd_fd = -1;
+	}
+}
+
+static struct zygote *find_zygote(const char *agent)
+{
+	struct zygote *z;
+
+	for (z = zygotes; z; z = z->next) {
+		if (z->cmd_fd >= 0 && strcmp(z->agent, agent) == 0)
+			return z;
+	}
+	return NULL;
+}
+
+static struct zygote *spawn_zygote(const char *agent)
+{
+	char script[PATH_MAX], path[PATH_MAX + 8], root[PATH_MAX + 16];
+	char fdir[PATH_MAX + 24];
+	char *envp[4];
+	int cmd[2], st[2];
+	struct zygote *z;
+	const char *s;
+	int i = 0;
+
+	z = calloc(1, sizeof(*z));
+	if (!z || !(z->agent = strdup(agent))) {
+		syslog(LOG_ERR, "out of memory");
+		exit(2);
+	}
+	if (pipe2(cmd, O_CLOEXEC) < 0) {
+		goto fail;
+	}
+	if (pipe2(st, O_CLOEXEC) < 0) {
+		close(cmd[0]);
+		close(cmd[1]);
+		goto fail;
+	}
+
+	/* the requests bring the environment of the clients */
+	snprintf(script, sizeof(script), "%s/ocf-rahost", functions_dir);
+	s = getenv("PATH");
+	snprintf(path, sizeof(path), "PATH=%s",
+		 s ? s : "/usr/sbin:/usr/bin:/sbin:/bin");
+	envp[i++] = path;
+	s = getenv("OCF_ROOT");
+	snprintf(root, sizeof(root), "OCF_ROOT=%s", s ? s : OCF_ROOT_DIR);
+	envp[i++] = root;
+	snprintf(fdir, sizeof(fdir), "OCF_FUNCTIONS_DIR=%s", functions_dir);
+	envp[i++] = fdir;
+	envp[i] = NULL;
+
+	z->pid = fork();
+	if (z->pid == 0) {
+		dup2(cmd[0], 0);
+		dup2(st[1], 3);
+		execle(RAHOST_SHELL, "bash", script, (char *)NULL, envp);
+		_exit(127);
+	}
+	close(cmd[0]);
+	close(st[1]);
+	if (z->pid < 0) {
+		close(cmd[1]);
+		close(st[0]);
+		goto fail;
+	}
+	z->cmd_fd = cmd[1];
+	z->st_fd = st[0];
+	z->idx = -1;
+	z->next = zygotes;
+	zygotes = z;
+	return z;
+fail:
+	syslog(LOG_ERR, "cannot start an interpreter for %s: %s",
+	       agent, strerror(errno));
+	free(z->agent);
+	free(z);
+	return NULL;
+}
+
+/* "rc outlen errlen\n", stdout, stderr */
+static void reply(struct request *r, int rc, const char *msg)
+{
+	char path[PATH_MAX], head[64];
+	char *out = NULL;
+	size_t len = 0, size = 0, olen = 0;
+	char buf[8192];
+	ssize_t n;
+	int fd, i;
+
+	if (r->fd < 0)
+		return;
+	fcntl(r->fd, F_SETFL, fcntl(r->fd, F_GETFL) & ~O_NONBLOCK);
+	for (i = 0; i < 2; i++) {
+		if (msg) {
+			if (i == 1)
+				append(&out, &len, &size, msg, strlen(msg));
+		} else {
+			out_path(path, sizeof(path), r->id, i ? "err" : "out");
+			fd = open(path, O_RDONLY | O_CLOEXEC);
+			while (fd >= 0 && (n = read(fd, buf, sizeof(buf))) > 0)
+				append(&out, &len, &size, buf, n);
+			if (fd >= 0)
+				close(fd);
+		}
+		if (i == 0)
+			olen = len;
+	}
+	snprintf(head, sizeof(head), "%d %lu %lu\n", rc,
+		 (unsigned long)olen, (unsigned long)(len - olen));
+	if (write_all(r->fd, head, strlen(head)) < 0
+	    || write_all(r->fd, out ? out : "", len) < 0) {
+		syslog(LOG_WARNING, "cannot reply to client: %s", strerror(errno));
+	}
+	free(out);
+	close(r->fd);
+	r->fd = -1;
+}
+
+static void free_request(struct request *r)
+{
+	struct request **pp;
+	char path[PATH_MAX];
+
+	for (pp = &requests; *pp; pp = &(*pp)->next) {
+		if (*pp == r) {
+			*pp = r->next;
+			break;
+		}
+	}
+	if (r->z) {
+		out_path(path, sizeof(path), r->id, "req");
+		unlink(path);
+		out_path(path, sizeof(path), r->id, "out");
+		unlink(path);
+		out_path(path, sizeof(path), r->id, "err");
+		unlink(path);
+	}
+	if (r->fd >= 0)
+		close(r->fd);
+	free(r->in);
+	free(r);
+}
+
+/*
+ * Kill the process group of a job, and the groups below it: an agent
+ * which turns on job control (set -m) puts its background jobs in
+ * process groups of their own. The job is stopped first, so that none
+ * of those is orphaned while we look for them in /proc.
+ */
+static void kill_job(pid_t pid)
+{
+	struct proc {
+		pid_t pid, ppid, pgrp;
+		int in_job;
+	} *procs = NULL, *p;
+	size_t n = 0, size = 0, i;
+	char path[64], buf[512], *s;
+	struct dirent *de;
+	DIR *d;
+	FILE *f;
+	int more;
+
+	kill(-pid, SIGSTOP);
+	d = opendir("/proc");
+	while (d && (de = readdir(d))) {
+		if (de->d_name[0] < '1' || de->d_name[0] > '9')
+			continue;
+		snprintf(path, sizeof(path), "/proc/%s/stat", de->d_name);
+		f = fopen(path, "r");
+		if (!f)
+			continue;
+		s = fgets(buf, sizeof(buf), f) ? strrchr(buf, ')') : NULL;
+		fclose(f);
+		if (n == size) {
+			size = size ? size * 2 : 256;
+			p = realloc(procs, size * sizeof(*procs));
+			if (!p)
+				break;
+			procs = p;
+		}
+		p = &procs[n];
+		if (!s || sscanf(s, ") %*c %d %d", &p->ppid, &p->pgrp) != 2)
+			continue;
+		p->pid = atoi(de->d_name);
+		p->in_job = p->pgrp == pid;
+		n++;
+	}
+	if (d)
+		closedir(d);
+
+	do {
+		more = 0;
+		for (p = procs; p < procs + n; p++) {
+			if (p->in_job)
+				continue;
+			for (i = 0; i < n; i++) {
+				if (procs[i].in_job && procs[i].pid == p->ppid)
+					break;
+			}
+			if (i < n) {
+				p->in_job = 1;
+				more = 1;
+			}
+		}
+	} while (more);
+
+	for (p = procs; p < procs + n; p++) {
+		if (p->in_job && p->pgrp != pid && p->pgrp != getpgrp())
+			kill(-p->pgrp, SIGKILL);
+	}
+	kill(-pid, SIGKILL);
+	free(procs);
+}
+
+/* hand a complete request to the interpreter of its agent */
+static int dispatch(struct request *r)
+{
+	char *msg = NULL;
+	const char *agent = r->in, *action, *p, *eq;
+	const char *end = r->in + r->in_len;
+	char path[PATH_MAX], line[PATH_MAX + 32];
+	size_t len = 0, size = 0;
+	struct zygote *z;
+	int fd, tries;
+
+	action = agent + strlen(agent) + 1;
+	if (agent[0] != '/' || access(agent, R_OK) < 0) {
+		reply(r, 5, "ocf_rahost: no such agent\n");
+		return -1;
+	}
+
+	for (p = action + strlen(action) + 1; p < end && *p;
+	     p += strlen(p) + 1) {
+		eq = strchr(p, '=');
+		if (!eq || !env_ok(p, eq - p))
+			continue;
+		append(&msg, &len, &size, "export ", 7);
+		append(&msg, &len, &size, p, eq - p + 1);
+		append_quoted(&msg, &len, &size, eq + 1, strlen(eq + 1));
+		append(&msg, &len, &size, "\n", 1);
+	}
+	append(&msg, &len, &size, "__rahost_agent=", 15);
+	append_quoted(&msg, &len, &size, agent, strlen(agent));
+	append(&msg, &len, &size, "\n__rahost_action=", 17);
+	append_quoted(&msg, &len, &size, action, strlen(action));
+	out_path(path, sizeof(path), r->id, "out");
+	append(&msg, &len, &size, "\n__rahost_out=", 14);
+	append_quoted(&msg, &len, &size, path, strlen(path));
+	out_path(path, sizeof(path), r->id, "err");
+	append(&msg, &len, &size, "\n__rahost_err=", 14);
+	append_quoted(&msg, &len, &size, path, strlen(path));
+	append(&msg, &len, &size, "\n", 1);
+
+	/*
+	 * bash reads a pipe a byte at a time, so the interpreter only gets
+	 * the name of a file to source in the job
+	 */
+	out_path(path, sizeof(path), r->id, "req");
+	fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+	if (fd < 0 || write_all(fd, msg, len) < 0) {
+		if (fd >= 0)
+			close(fd);
+		free(msg);
+		reply(r, OCF_ERR_GENERIC, "ocf_rahost: cannot run the agent\n");
+		return -1;
+	}
+	close(fd);
+	free(msg);
+	snprintf(line, sizeof(line), "%u %s\n", r->id, path);
+
+	if (functions_changed()) {
+		for (z = zygotes; z; z = z->next)
+			retire(z);
+	}
+	/* an interpreter may have died since its last request */
+	for (tries = 0; tries < 2; tries++) {
+		z = find_zygote(agent);
+		if (!z)
+			z = spawn_zygote(agent);
+		if (!z)
+			break;
+		if (write_all(z->cmd_fd, line, strlen(line)) == 0) {
+			r->z = z;
+			return 0;
+		}
+		retire(z);
+	}
+	unlink(path);
+	reply(r, OCF_ERR_GENERIC, "ocf_rahost: cannot run the agent\n");
+	return -1;
+}
+
+static void client_input(struct request *r)
+{
+	char buf[8192];
+	const char *p, *end;
+	ssize_t n;
+	int fields = 0;
+
+	n = read(r->fd, buf, sizeof(buf));
+	if (n < 0 && (errno == EINTR || errno == EAGAIN))
+		return;
+	if (n <= 0) {
+		if (r->z && r->pid > 0) {
+			/* the client gave up, and so do we */
+			kill_job(r->pid);
+		}
+		close(r->fd);
+		r->fd = -1;
+		if (!r->z)
+			free_request(r);
+		return;
+	}
+	if (r->z)
+		return;
+	if (r->in_len + n > RAHOST_MAX_REQUEST) {
+		syslog(LOG_WARNING, "request too large");
+		free_request(r);
+		return;
+	}
+	append(&r->in, &r->in_len, &r->in_size, buf, n);
+
+	/* complete with agent, action and an empty string at the end */
+	end = r->in + r->in_len;
+	for (p = r->in; p < end; p += strlen(p) + 1) {
+		if (!memchr(p, 0, end - p))
+			return;
+		if (!*p && fields >= 2) {
+			if (dispatch(r) < 0)
+				free_request(r);
+			return;
+		}
+		fields++;
+	}
+}
+
+static struct request *find_request(unsigned id)
+{
+	struct request *r;
+
+	for (r = requests; r; r = r->next) {
+		if (r->id == id)
+			return r;
+	}
+	return NULL;
+}
+
+static void zygote_line(struct zygote *z, char *line)
+{
+	struct request *r;
+	unsigned id;
+	long v;
+	char what[8];
+
+	if (sscanf(line, "%7s %u %ld", what, &id, &v) != 3)
+		return;
+	r = find_request(id);
+	if (!r || r->z != z)
+		return;
+	if (strcmp(what, "pid") == 0) {
+		r->pid = v;
+		/* the client may be gone already */
+		if (r->fd < 0)
+			kill_job(r->pid);
+	} else if (strcmp(what, "done") == 0) {
+		reply(r, v, NULL);
+		free_request(r);
+	}
+}
+
+static void zygote_input(struct zygote *z)
+{
+	struct zygote **pp;
+	struct request *r, *next;
+	char *nl, *line;
+	ssize_t n;
+
+	n = read(z->st_fd, z->st_buf + z->st_len, sizeof(z->st_buf) - z->st_len - 1);
+	if (n < 0 && (errno == EINTR || errno == EAGAIN))
+		return;
+	if (n > 0) {
+		z->st_len += n;
+		z->st_buf[z->st_len] = 0;
+		line = z->st_buf;
+		while ((nl = strchr(line, '\n')) != NULL) {
+			*nl = 0;
+			zygote_line(z, line);
+			line = nl + 1;
+		}
+		z->st_len -= line - z->st_buf;
+		memmove(z->st_buf, line, z->st_len);
+		if (z->st_len < sizeof(z->st_buf) - 1)
+			return;
+		/* no line is that long */
+		syslog(LOG_ERR, "garbage from the interpreter for %s", z->agent);
+	}
+
+	/* the interpreter and all its jobs are gone */
+	for (r = requests; r; r = next) {
+		next = r->next;
+		if (r->z == z) {
+			reply(r, OCF_ERR_GENERIC,
+			      "ocf_rahost: the interpreter exited\n");
+			free_request(r);
+		}
+	}
+	for (pp = &zygotes; *pp; pp = &(*pp)->next) {
+		if (*pp == z) {
+			*pp = z->next;
+			break;
+		}
+	}
+	retire(z);
+	close(z->st_fd);
+	waitpid(z->pid, NULL, 0);
+	free(z->agent);
+	free(z);
+}
+
+static void new_client(int lfd)
+{
+	struct request *r;
+	struct ucred cred;
+	socklen_t len = sizeof(cred);
+	int fd;
+
+	fd = accept4(lfd, NULL, NULL, SOCK_CLOEXEC | SOCK_NONBLOCK);
+	if (fd < 0)
+		return;
+	if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &len) < 0
+	    || cred.uid != getuid()) {
+		close(fd);
+		return;
+	}
+	r = calloc(1, sizeof(*r));
+	if (!r) {
+		close(fd);
+		return;
+	}
+	r->id = ++next_id;
+	r->fd = fd;
+	r->idx = -1;
+	r->next = requests;
+	requests = r;
+}
+
+static int host(void)
+{
+	struct sockaddr_un sun;
+	struct pollfd *pfd = NULL;
+	size_t npfd = 0;
+	struct request *r, *rnext;
+	struct zygote *z, *znext;
+	size_t n, nclients;
+	int lfd;
+
+	openlog("ocf_rahost", LOG_PID, LOG_DAEMON);
+	signal(SIGPIPE, SIG_IGN);
+	mkdir(rsctmp(), 0755);
+	snprintf(workdir, sizeof(workdir), "%s/ocf_rahost.XXXXXX", rsctmp());
+	if (!mkdtemp(workdir)) {
+		fprintf(stderr, "Cannot create %s: %s\n", workdir, strerror(errno));
+		return 2;
+	}
+	functions_changed();
+
+	memset(&sun, 0, sizeof(sun));
+	sun.sun_family = AF_UNIX;
+	if (strlen(socket_path()) >= sizeof(sun.sun_path)) {
+		fprintf(stderr, "Socket path too long\n");
+		return 2;
+	}
+	strcpy(sun.sun_path, socket_path());
+	unlink(sun.sun_path);
+	lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if (lfd < 0 || bind(lfd, (struct sockaddr *)&sun, sizeof(sun)) < 0
+	    || chmod(sun.sun_path, 0600) < 0 || listen(lfd, 64) < 0) {
+		fprintf(stderr, "Cannot listen on %s: %s\n", sun.sun_path,
+			strerror(errno));
+		return 2;
+	}
+
+	for (;;) {
+		nclients = 0;
+		n = 1;
+		for (r = requests; r; r = r->next)
+			n++;
+		for (z = zygotes; z; z = z->next)
+			n++;
+		if (n > npfd) {
+			npfd = n * 2;
+			pfd = realloc(pfd, npfd * sizeof(*pfd));
+			if (!pfd) {
+				syslog(LOG_ERR, "out of memory");
+				return 2;
+			}
+		}
+		n = 0;
+		for (r = requests; r; r = r->next) {
+			r->idx = n;
+			pfd[n].fd = r->fd;
+			pfd[n].events = POLLIN;
+			n++;
+			if (r->fd >= 0)
+				nclients++;
+		}
+		for (z = zygotes; z; z = z->next) {
+			z->idx = n;
+			pfd[n].fd = z->st_fd;
+			pfd[n].events = POLLIN;
+			n++;
+		}
+		/* too many clients wait in the backlog */
+		pfd[n].fd = nclients < RAHOST_MAX_CLIENTS ? lfd : -1;
+		pfd[n].events = POLLIN;
+		n++;
+
+		if (poll(pfd, n, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			syslog(LOG_ERR, "poll: %s", strerror(errno));
+			return 2;
+		}
+
+		/* new entries have no place in pfd yet */
+		for (r = requests; r; r = rnext) {
+			rnext = r->next;
+			if (r->idx >= 0 && pfd[r->idx].revents && r->fd >= 0)
+				client_input(r);
+		}
+		for (z = zygotes; z; z = znext) {
+			znext = z->next;
+			if (z->idx >= 0 && pfd[z->idx].revents)
+				zygote_input(z);
+		}
+		if (pfd[n - 1].revents)
+			new_client(lfd);
+		while (waitpid(-1, NULL, WNOHANG) > 0)
+			;
+	}
+}
+
+static void usage(void)
+{
+	printf("Usage: /usr/lib/heartbeat/ocf_rahost -d\n");
+	printf("Runs the resource agent host until killed.\n");
+	printf("\n");
+	printf("       /usr/lib/heartbeat/ocf_rahost agent action\n");
+	printf("       agent action   (through a symlink named after the agent)\n");
+	printf("Runs the action of the agent in the host, or directly if\n");
+	printf("there is no host, and exits with its exit code.\n");
+	exit(2);
+}
+
+int main(int argc, char *argv[])
+{
+	char agent[PATH_MAX];
+	const char *name, *root, *provider;
+
+	name = strrchr(argv[0], '/');
+	name = name ? name + 1 : argv[0];
+	if (strcmp(name, "ocf_rahost") != 0) {
+		/* a symlink in a provider directory */
+		root = getenv("OCF_ROOT");
+		provider = getenv("OCF_RAHOST_PROVIDER");
+		snprintf(agent, sizeof(agent), "%s/resource.d/%s/%s",
+			 root ? root : OCF_ROOT_DIR,
+			 provider ? provider : "heartbeat", name);
+		return client(agent, argv);
+	}
+
+	if (argc == 2 && strcmp(argv[1], "-d") == 0) {
+		functions_dir = getenv("OCF_FUNCTIONS_DIR");
+		if (!functions_dir) {
+			root = getenv("OCF_ROOT");
+			snprintf(agent, sizeof(agent), "%s/lib/heartbeat",
+				 root ? root : OCF_ROOT_DIR);
+			functions_dir = strdup(agent);
+		}
+		return host();
+	}
+	if (argc < 2 || argv[1][0] == '-') {
+		usage();
+	}
+	return client(argv[1], argv + 1);
+}
@@ -0,0 +1,57 @@
+/*
+ * Helpers shared by the long running tools of the resource agents.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <limits.h>
+#include <time.h>
+#include <unistd.h>
+#include <syslog.h>
+
+#include "ocf_util.h"
+
+long now_ms(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+void write_state(const char *path, void (*print)(FILE *f, void *arg),
+		 void *arg)
+{
+	char tmp[PATH_MAX];
+	FILE *f;
+
+	if (!path)
+		return;
+	if (snprintf(tmp, sizeof(tmp), "%s.new", path) >= (int)sizeof(tmp))
+		return;
+	f = fopen(tmp, "w");
+	if (!f) {
+		syslog(LOG_WARNING, "cannot write %s: %s", tmp, strerror(errno));
+		return;
+	}
+	print(f, arg);
+	if (fclose(f) != 0 || rename(tmp, path) < 0) {
+		syslog(LOG_WARNING, "cannot write %s: %s", path, strerror(errno));
+		unlink(tmp);
+	}
+}
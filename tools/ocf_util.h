@@ -0,0 +1,36 @@
+/*
+ * Helpers shared by the long running tools of the resource agents:
+ * the clock they time their waits with, and the state file the
+ * monitor of an agent reads instead of asking the tool.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef OCF_UTIL_H
+#define OCF_UTIL_H
+
+#include <stdio.h>
+
+/* milliseconds of CLOCK_MONOTONIC */
+long now_ms(void);
+
+/*
+ * Replace the state file at path (nothing if it is NULL) with what
+ * print writes, so that readers never see half of it. Failures are
+ * logged to syslog.
+ */
+void write_state(const char *path, void (*print)(FILE *f, void *arg),
+		 void *arg);
+
+#endif /* OCF_UTIL_H */
@@ -19,12 +19,13 @@ loopbackeddev() {
 				echo "usage: $0 action file size" >&2
 				exit 1
 			fi
-			loopdev=`losetup -f`
 			if ! dd if=/dev/zero of=$file bs=1 count=0 seek=$size 2>/dev/null; then
 				echo "$0: dd failed" >&2
 				exit 1
 			fi
-			if ! losetup $loopdev $file; then
+			# find and take a free device in one go, "ocft test -j"
+			# may be setting up others at the same time
+			if ! loopdev=`losetup -f --show $file`; then
 				echo "$0: losetup failed" >&2
 				exit 1
 			fi
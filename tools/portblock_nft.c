@@ -0,0 +1,512 @@
+/*
+   nftables backend for the portblock resource agent
+
+   All portblock instances share one table, "inet portblock", with an
+   input chain that drops packets whose protocol, destination address
+   and destination port are in a set, and an output chain that answers
+   packets whose protocol, source address and source port are in
+   another set with a TCP reset (for reset_local_on_unblock_stop).
+   There are separate sets for IPv4 addresses, IPv6 addresses and for
+   any address (ip=0.0.0.0/0).
+
+   Blocking and unblocking a port is then adding or removing a set
+   element in one atomic nf_tables transaction, and the status check a
+   single element lookup, instead of inserting rules and listing the
+   whole INPUT chain. The table, chains, sets and rules are created on
+   first use, in one transaction.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "nft_batch.h"
+
+/* exit codes */
+#define PB_OK		0
+#define PB_ABSENT	1	/* check: not (completely) blocked */
+#define PB_ERROR	2
+
+#define PB_TABLE	"portblock"
+
+/* elements per NEWSETELEM message */
+#define PB_ELEMS_PER_MSG	1024
+
+enum pb_kind {
+	PB_ANY,
+	PB_INET,
+	PB_INET6
+};
+
+struct pb_set {
+	const char *name;
+	const char *chain;
+	enum pb_kind kind;
+	int addr_off;		/* in the network header */
+	int port_off;		/* in the transport header */
+	int reset;		/* reject with tcp reset instead of drop */
+};
+
+/*
+ * The set id only identifies the set within the transaction that
+ * creates it; it is the index in this table plus one.
+ */
+static const struct pb_set pb_sets[] = {
+	{ "block",  "input",  PB_ANY,   0,  2, 0 },
+	{ "block4", "input",  PB_INET,  16, 2, 0 },
+	{ "block6", "input",  PB_INET6, 24, 2, 0 },
+	{ "reset",  "output", PB_ANY,   0,  0, 1 },
+	{ "reset4", "output", PB_INET,  12, 0, 1 },
+	{ "reset6", "output", PB_INET6, 8,  0, 1 },
+};
+#define PB_NSETS (sizeof(pb_sets) / sizeof(pb_sets[0]))
+
+/* the key of one set element: protocol . [address .] port */
+struct pb_key {
+	unsigned char data[4 + 16 + 4];
+	int len;
+};
+
+struct pb_keys {
+	const struct pb_set *set;
+	struct pb_key *keys;
+	unsigned long count;
+};
+
+static void expr_reset(struct nft_buf *b);
+static int addr_len(enum pb_kind kind);
+static void add_chain(struct nft_buf *b, const char *name, int hook);
+static void add_set(struct nft_buf *b, int i);
+static void add_rule(struct nft_buf *b, int i);
+static void add_elems(struct nft_buf *b, int type, int flags,
+		      const struct pb_keys *k);
+static int pb_init(int fd);
+static int pb_change(int fd, int add, const struct pb_keys *k);
+static int pb_check(int fd, const struct pb_keys *k);
+static int parse_keys(const char *proto, const char *ip, const char *ports,
+		      int reset, struct pb_keys *k);
+static void usage(void);
+
+static void expr_reset(struct nft_buf *b)
+{
+	struct nft_expr e;
+
+	nft_expr_begin(b, &e, "reject");
+	nft_attr_put_u32(b, NFTA_REJECT_TYPE, NFT_REJECT_TCP_RST);
+	nft_expr_end(b, &e);
+}
+
+static int addr_len(enum pb_kind kind)
+{
+	switch (kind) {
+	case PB_INET:
+		return 4;
+	case PB_INET6:
+		return 16;
+	default:
+		return 0;
+	}
+}
+
+static void add_chain(struct nft_buf *b, const char *name, int hook)
+{
+	size_t m, h;
+
+	m = nft_msg_begin(b, NFT_MSG(NFT_MSG_NEWCHAIN),
+		      NFPROTO_INET, NLM_F_CREATE | NLM_F_ACK);
+	nft_attr_put_str(b, NFTA_CHAIN_TABLE, PB_TABLE);
+	nft_attr_put_str(b, NFTA_CHAIN_NAME, name);
+	h = nft_nest_begin(b, NFTA_CHAIN_HOOK);
+	nft_attr_put_u32(b, NFTA_HOOK_HOOKNUM, hook);
+	nft_attr_put_u32(b, NFTA_HOOK_PRIORITY, 0);
+	nft_nest_end(b, h);
+	nft_attr_put_u32(b, NFTA_CHAIN_POLICY, NF_ACCEPT);
+	nft_attr_put_str(b, NFTA_CHAIN_TYPE, "filter");
+	nft_msg_end(b, m);
+}
+
+static void add_set(struct nft_buf *b, int i)
+{
+	const struct pb_set *s = &pb_sets[i];
+	uint32_t type = NFT_TYPE_INET_PROTOCOL;
+	size_t m;
+
+	if (s->kind == PB_INET)
+		type = (type << NFT_TYPE_BITS) | NFT_TYPE_IPADDR;
+	else if (s->kind == PB_INET6)
+		type = (type << NFT_TYPE_BITS) | NFT_TYPE_IP6ADDR;
+	type = (type << NFT_TYPE_BITS) | NFT_TYPE_INET_SERVICE;
+
+	m = nft_msg_begin(b, NFT_MSG(NFT_MSG_NEWSET),
+		      NFPROTO_INET, NLM_F_CREATE | NLM_F_ACK);
+	nft_attr_put_str(b, NFTA_SET_TABLE, PB_TABLE);
+	nft_attr_put_str(b, NFTA_SET_NAME, s->name);
+	nft_attr_put_u32(b, NFTA_SET_FLAGS, 0);
+	nft_attr_put_u32(b, NFTA_SET_KEY_TYPE, type);
+	nft_attr_put_u32(b, NFTA_SET_KEY_LEN, 4 + addr_len(s->kind) + 4);
+	nft_attr_put_u32(b, NFTA_SET_ID, i + 1);
+	nft_msg_end(b, m);
+}
+
+/*
+ * The key is built in consecutive 32 bit registers, each field padded
+ * to 4 bytes, which is also how set elements are laid out:
+ *   meta l4proto . ip[6] [sd]addr . th [sd]port @set drop|reject
+ */
+static void add_rule(struct nft_buf *b, int i)
+{
+	const struct pb_set *s = &pb_sets[i];
+	uint8_t nfproto;
+	uint32_t reg = NFT_REG32_00;
+	size_t m, l;
+
+	m = nft_msg_begin(b, NFT_MSG(NFT_MSG_NEWRULE),
+		      NFPROTO_INET, NLM_F_CREATE | NLM_F_APPEND | NLM_F_ACK);
+	nft_attr_put_str(b, NFTA_RULE_TABLE, PB_TABLE);
+	nft_attr_put_str(b, NFTA_RULE_CHAIN, s->chain);
+	l = nft_nest_begin(b, NFTA_RULE_EXPRESSIONS);
+
+	if (s->kind != PB_ANY) {
+		nfproto = (s->kind == PB_INET) ? NFPROTO_IPV4 : NFPROTO_IPV6;
+		nft_expr_meta(b, NFT_META_NFPROTO, NFT_REG_1);
+		nft_expr_cmp_eq(b, NFT_REG_1, &nfproto, sizeof(nfproto));
+	}
+	nft_expr_meta(b, NFT_META_L4PROTO, reg++);
+	if (s->kind != PB_ANY) {
+		nft_expr_payload(b, NFT_PAYLOAD_NETWORK_HEADER, s->addr_off,
+			     addr_len(s->kind), reg);
+		reg += addr_len(s->kind) / 4;
+	}
+	nft_expr_payload(b, NFT_PAYLOAD_TRANSPORT_HEADER, s->port_off, 2, reg);
+	nft_expr_lookup(b, s->name, i + 1, NFT_REG32_00, 0);
+	if (s->reset)
+		expr_reset(b);
+	else
+		nft_expr_drop(b);
+
+	nft_nest_end(b, l);
+	nft_msg_end(b, m);
+}
+
+static void add_elems(struct nft_buf *b, int type, int flags,
+		      const struct pb_keys *k)
+{
+	unsigned long i;
+	size_t m = 0, l = 0, e, d;
+
+	for (i = 0; i < k->count; i++) {
+		if (i % PB_ELEMS_PER_MSG == 0) {
+			if (i) {
+				nft_nest_end(b, l);
+				nft_msg_end(b, m);
+			}
+			m = nft_msg_begin(b, NFT_MSG(type),
+				      NFPROTO_INET, flags | NLM_F_ACK);
+			nft_attr_put_str(b, NFTA_SET_ELEM_LIST_TABLE, PB_TABLE);
+			nft_attr_put_str(b, NFTA_SET_ELEM_LIST_SET, k->set->name);
+			l = nft_nest_begin(b, NFTA_SET_ELEM_LIST_ELEMENTS);
+		}
+		e = nft_nest_begin(b, NFTA_LIST_ELEM);
+		d = nft_nest_begin(b, NFTA_SET_ELEM_KEY);
+		nft_attr_put(b, NFTA_DATA_VALUE, k->keys[i].data, k->keys[i].len);
+		nft_nest_end(b, d);
+		nft_nest_end(b, e);
+	}
+	if (k->count) {
+		nft_nest_end(b, l);
+		nft_msg_end(b, m);
+	}
+}
+
+/* create the table and everything in it, unless the table exists */
+static int pb_init(int fd)
+{
+	struct nft_buf b;
+	size_t m;
+	unsigned i;
+	int ret;
+
+	memset(&b, 0, sizeof(b));
+	nft_batch_begin(&b);
+	m = nft_msg_begin(&b, NFT_MSG(NFT_MSG_NEWTABLE),
+		      NFPROTO_INET, NLM_F_CREATE | NLM_F_EXCL | NLM_F_ACK);
+	nft_attr_put_str(&b, NFTA_TABLE_NAME, PB_TABLE);
+	nft_attr_put_u32(&b, NFTA_TABLE_FLAGS, 0);
+	nft_msg_end(&b, m);
+	add_chain(&b, "input", NF_INET_LOCAL_IN);
+	add_chain(&b, "output", NF_INET_LOCAL_OUT);
+	for (i = 0; i < PB_NSETS; i++) {
+		add_set(&b, i);
+		add_rule(&b, i);
+	}
+	nft_batch_end(&b);
+
+	ret = nft_talk(fd, &b);
+	free(b.data);
+	/* another instance got there first; the batch is all or nothing */
+	if (ret == -EEXIST)
+		ret = 0;
+	return ret;
+}
+
+/*
+ * Add or remove the elements in one transaction. Removal first adds
+ * them (which is no error if they exist), so that removing elements
+ * that are not there succeeds as well.
+ */
+static int pb_change(int fd, int add, const struct pb_keys *k)
+{
+	struct nft_buf b;
+	int ret;
+
+	memset(&b, 0, sizeof(b));
+	nft_batch_begin(&b);
+	add_elems(&b, NFT_MSG_NEWSETELEM, NLM_F_CREATE, k);
+	if (!add)
+		add_elems(&b, NFT_MSG_DELSETELEM, 0, k);
+	nft_batch_end(&b);
+
+	ret = nft_talk(fd, &b);
+	free(b.data);
+	return ret;
+}
+
+/* PB_OK if all elements are in the set, PB_ABSENT if not */
+static int pb_check(int fd, const struct pb_keys *k)
+{
+	struct nft_buf b;
+	struct pb_keys one;
+	unsigned long i;
+	int ret = 0;
+
+	memset(&b, 0, sizeof(b));
+	one = *k;
+	one.count = 1;
+	for (i = 0; i < k->count && ret == 0; i++) {
+		one.keys = &k->keys[i];
+		add_elems(&b, NFT_MSG_GETSETELEM, 0, &one);
+		ret = nft_talk(fd, &b);
+	}
+	free(b.data);
+
+	if (ret == -ENOENT)
+		return PB_ABSENT;
+	if (ret < 0) {
+		fprintf(stderr, "Failed to look up %s (%s)\n",
+			k->set->name, strerror(-ret));
+		return PB_ERROR;
+	}
+	return PB_OK;
+}
+
+/*
+ * proto is tcp or udp, ip an address or 0.0.0.0/0 (::/0) for any,
+ * ports a comma separated list of ports and lo:hi ranges, as for the
+ * iptables multiport match.
+ */
+static int parse_keys(const char *proto, const char *ip, const char *ports,
+		      int reset, struct pb_keys *k)
+{
+	uint8_t p;
+	unsigned char addr[16];
+	char *copy, *s, *tok, *end, *save = NULL;
+	unsigned long lo, hi, port;
+	enum pb_kind kind;
+	struct pb_key *key;
+	unsigned i;
+	size_t iplen;
+
+	if (strcmp(proto, "tcp") == 0) {
+		p = IPPROTO_TCP;
+	} else if (strcmp(proto, "udp") == 0) {
+		p = IPPROTO_UDP;
+	} else {
+		fprintf(stderr, "Bad protocol %s\n", proto);
+		return -1;
+	}
+
+	iplen = strlen(ip);
+	if (strcmp(ip, "0.0.0.0/0") == 0 || strcmp(ip, "::/0") == 0) {
+		kind = PB_ANY;
+	} else {
+		copy = strdup(ip);
+		if (!copy) {
+			fprintf(stderr, "Failed strdup()\n");
+			return -1;
+		}
+		/* a host prefix is the address itself */
+		if (iplen > 3 && strcmp(copy + iplen - 3, "/32") == 0)
+			copy[iplen - 3] = 0;
+		else if (iplen > 4 && strcmp(copy + iplen - 4, "/128") == 0)
+			copy[iplen - 4] = 0;
+		if (inet_pton(AF_INET, copy, addr) == 1) {
+			kind = PB_INET;
+		} else if (inet_pton(AF_INET6, copy, addr) == 1) {
+			kind = PB_INET6;
+		} else {
+			fprintf(stderr, "%s is not an address or 0.0.0.0/0\n", ip);
+			free(copy);
+			return -1;
+		}
+		free(copy);
+	}
+
+	for (i = 0; i < PB_NSETS; i++) {
+		if (pb_sets[i].kind == kind && pb_sets[i].reset == reset)
+			k->set = &pb_sets[i];
+	}
+	k->keys = NULL;
+	k->count = 0;
+
+	copy = strdup(ports);
+	if (!copy) {
+		fprintf(stderr, "Failed strdup()\n");
+		return -1;
+	}
+	for (s = copy; (tok = strtok_r(s, ",", &save)) != NULL; s = NULL) {
+		lo = strtoul(tok, &end, 10);
+		hi = lo;
+		if (end != tok && *end == ':') {
+			tok = end + 1;
+			hi = strtoul(tok, &end, 10);
+		}
+		if (end == tok || *end != 0 || lo > hi || hi > 65535) {
+			fprintf(stderr, "Bad port list %s\n", ports);
+			free(copy);
+			return -1;
+		}
+		key = realloc(k->keys, (k->count + hi - lo + 1) * sizeof(*key));
+		if (!key) {
+			fprintf(stderr, "Failed realloc()\n");
+			free(copy);
+			return -1;
+		}
+		k->keys = key;
+		for (port = lo; port <= hi; port++) {
+			key = &k->keys[k->count++];
+			memset(key, 0, sizeof(*key));
+			key->data[0] = p;
+			memcpy(key->data + 4, addr, addr_len(kind));
+			key->data[4 + addr_len(kind)] = port >> 8;
+			key->data[4 + addr_len(kind) + 1] = port & 0xff;
+			key->len = 4 + addr_len(kind) + 4;
+		}
+	}
+	free(copy);
+
+	if (k->count == 0) {
+		fprintf(stderr, "No ports in %s\n", ports);
+		return -1;
+	}
+	return 0;
+}
+
+static void usage(void)
+{
+	printf("Usage: /usr/lib/heartbeat/portblock_nft [ -r ] {add|del|check|parse} {tcp|udp} ip ports\n");
+	printf("  add    drop incoming packets to ip and ports\n");
+	printf("  del    stop dropping them\n");
+	printf("  check  exit with 0 if they are dropped, 1 if not\n");
+	printf("  parse  only check the arguments\n");
+	printf("  -r     answer outgoing packets from ip and ports with a TCP\n");
+	printf("         reset, instead of dropping incoming packets\n");
+	printf("ip is an address, or 0.0.0.0/0 for any address; ports is a list\n");
+	printf("of ports and port ranges, such as 21,22,1000:1010.\n");
+	printf("Exits with 2 on errors.\n");
+	exit(PB_ERROR);
+}
+
+#define OPTION_STRING "rh"
+
+int main(int argc, char *argv[])
+{
+	int optchar, cont = 1, reset = 0;
+	const char *cmd;
+	struct pb_keys k;
+	int fd, ret;
+
+	while(cont) {
+		optchar = getopt(argc, argv, OPTION_STRING);
+		switch(optchar) {
+		case 'r':
+			reset = 1;
+			break;
+		case 'h':
+			usage();
+			break;
+		case EOF:
+			cont = 0;
+			break;
+		default:
+			fprintf(stderr, "unknown option, please use '-h' for usage.\n");
+			exit(PB_ERROR);
+			break;
+		};
+	}
+
+	if (argc - optind != 4) {
+		usage();
+	}
+	cmd = argv[optind];
+	if (strcmp(cmd, "add") && strcmp(cmd, "del")
+	    && strcmp(cmd, "check") && strcmp(cmd, "parse")) {
+		usage();
+	}
+	if (parse_keys(argv[optind+1], argv[optind+2], argv[optind+3],
+		       reset, &k)) {
+		exit(PB_ERROR);
+	}
+	if (strcmp(cmd, "parse") == 0) {
+		exit(PB_OK);
+	}
+
+	fd = nft_open();
+	if (fd < 0) {
+		exit(PB_ERROR);
+	}
+
+	if (strcmp(cmd, "check") == 0) {
+		ret = pb_check(fd, &k);
+	} else if (strcmp(cmd, "del") == 0) {
+		ret = pb_change(fd, 0, &k);
+		/* no table, nothing to remove */
+		if (ret == -ENOENT)
+			ret = 0;
+		if (ret < 0)
+			fprintf(stderr, "Failed to remove from %s (%s)\n",
+				k.set->name, strerror(-ret));
+		ret = ret ? PB_ERROR : PB_OK;
+	} else {
+		ret = pb_init(fd);
+		if (ret == 0)
+			ret = pb_change(fd, 1, &k);
+		if (ret < 0)
+			fprintf(stderr, "Failed to add to %s (%s)\n",
+				k.set->name, strerror(-ret));
+		ret = ret ? PB_ERROR : PB_OK;
+	}
+
+	close(fd);
+	free(k.keys);
+	return ret;
+}
@@ -0,0 +1,106 @@
+/*
+ * rtnetlink sockets, dumps and reads.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#include "rtnl_util.h"
+
+int rtnl_open(unsigned groups)
+{
+	int fd;
+	struct sockaddr_nl snl;
+
+	fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open rtnetlink (%s)\n", strerror(errno));
+		return -1;
+	}
+	memset(&snl, 0, sizeof(snl));
+	snl.nl_family = AF_NETLINK;
+	snl.nl_groups = groups;
+	if (bind(fd, (struct sockaddr *)&snl, sizeof(snl)) < 0) {
+		fprintf(stderr, "Failed to bind rtnetlink (%s)\n", strerror(errno));
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+int rtnl_dump(int fd, int type, int family, uint32_t seq)
+{
+	struct {
+		struct nlmsghdr nlh;
+		struct rtgenmsg g;
+	} req;
+
+	memset(&req, 0, sizeof(req));
+	req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(req.g));
+	req.nlh.nlmsg_type = type;
+	req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.nlh.nlmsg_seq = seq;
+	req.g.rtgen_family = family;
+	if (send(fd, &req, req.nlh.nlmsg_len, 0) < 0) {
+		fprintf(stderr, "Failed to send netlink request (%s)\n",
+			strerror(errno));
+		return -1;
+	}
+	return 0;
+}
+
+int rtnl_read(int fd, uint32_t seq, int dump,
+	      void (*cb)(struct nlmsghdr *h, void *arg), void *arg)
+{
+	static char buf[RTNL_BUFSIZE];
+	struct nlmsghdr *h;
+	ssize_t len;
+
+	for (;;) {
+		len = recv(fd, buf, sizeof(buf), dump ? 0 : MSG_DONTWAIT);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (!dump && errno == EAGAIN)
+				return 0;
+			if (!dump && errno == ENOBUFS) {
+				cb(NULL, arg);
+				continue;
+			}
+			fprintf(stderr, "Failed to read rtnetlink (%s)\n",
+				strerror(errno));
+			return -1;
+		}
+		for (h = (struct nlmsghdr *)buf; NLMSG_OK(h, len);
+		     h = NLMSG_NEXT(h, len)) {
+			if (dump && h->nlmsg_seq != seq)
+				continue;
+			if (h->nlmsg_type == NLMSG_DONE)
+				return 0;
+			if (h->nlmsg_type == NLMSG_ERROR) {
+				fprintf(stderr, "rtnetlink dump failed (%s)\n",
+					strerror(-((struct nlmsgerr *)NLMSG_DATA(h))->error));
+				return -1;
+			}
+			cb(h, arg);
+		}
+	}
+}
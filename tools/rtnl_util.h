@@ -0,0 +1,43 @@
+/*
+ * rtnetlink sockets, dumps and reads, for the tools which follow the
+ * links, addresses and routes of the kernel without running ip.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef RTNL_UTIL_H
+#define RTNL_UTIL_H
+
+#include <stdint.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#define RTNL_BUFSIZE		65536
+
+/* an rtnetlink socket bound to the groups, or -1 after printing why not */
+int rtnl_open(unsigned groups);
+
+/* request a dump of the given type (RTM_GETxxx) and family */
+int rtnl_dump(int fd, int type, int family, uint32_t seq);
+
+/*
+ * Pass the messages to cb: those of the dump with the given sequence
+ * number until it is done, or, for the event socket (dump == 0), all
+ * that are queued without blocking. Lost events are reported as a
+ * NULL message. Returns 0, or -1 after printing why.
+ */
+int rtnl_read(int fd, uint32_t seq, int dump,
+	      void (*cb)(struct nlmsghdr *h, void *arg), void *arg);
+
+#endif /* RTNL_UTIL_H */
@@ -0,0 +1,657 @@
+/*
+ * rtroute.c:	Adds, deletes, finds and watches a route over rtnetlink
+ *
+ *	The route helper of the Route and IPsrcaddr resource agents. A
+ *	route is given the way "ip route" takes it:
+ *
+ *		[to] prefix|default [dev nic] [via gateway] [src address]
+ *		[table id|name] [proto id|name]
+ *
+ *	"show" prints the routes which match all given keys, as "ip route
+ *	show to exact" does (the main table unless another one is given,
+ *	"table all" for any), and exits with 0 if there are some, 1 if
+ *	none. "add" and "del" change the route.
+ *
+ *	"watch" runs until killed and keeps the answer of "show" in a
+ *	state file, "present" or "missing". It subscribes to the route
+ *	notifications of the family and only dumps the routes again when
+ *	one for the watched prefix comes in (or events were lost), so a
+ *	route that goes away is noticed at once, and the monitor of the
+ *	agent only has to read the state file.
+ *
+ *	Exit codes are 0 for success, 1 for "no such route" and 2 for
+ *	errors.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <syslog.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "rtnl_util.h"
+#include "ocf_util.h"
+
+#define RTROUTE_OK		0
+#define RTROUTE_MISSING		1
+#define RTROUTE_ERROR		2
+
+#define RTROUTE_TABLE_ALL	0xffffffffU
+
+/* the route given on the command line */
+struct route {
+	int family;
+	unsigned char dst[16];
+	unsigned dst_len;
+	int oif;
+	const char *dev;
+	int has_gw;
+	unsigned char gw[16];
+	int has_src;
+	unsigned char src[16];
+	uint32_t table;		/* 0: main for show, none for add */
+	int proto;		/* -1: any */
+};
+
+static int addr_len(int family);
+static int parse_addr(struct route *r, const char *s, unsigned char *addr);
+static int parse_prefix(struct route *r, const char *s);
+static int lookup_id(const char *file, const char *name, unsigned long *id);
+static int parse_id(const char *name, const char **files, unsigned long max,
+		    unsigned long *id);
+static int parse_route(struct route *r, char **argv);
+static uint32_t route_table(const struct rtmsg *rtm, struct rtattr **tb);
+static void parse_rtattr(struct rtattr **tb, struct nlmsghdr *h);
+static int attr_equal(struct rtattr *rta, const unsigned char *addr, int alen);
+static int route_matches(const struct route *r, struct nlmsghdr *h);
+static void print_route(struct nlmsghdr *h);
+static void show_msg(struct nlmsghdr *h, void *arg);
+static void count_msg(struct nlmsghdr *h, void *arg);
+static int route_dump(int fd, const struct route *r,
+		      void (*cb)(struct nlmsghdr *h, void *arg), void *arg);
+static void addattr(struct nlmsghdr *h, int type, const void *data, int len);
+static int route_change(int fd, const struct route *r, int del);
+static void event_msg(struct nlmsghdr *h, void *arg);
+static void print_state(FILE *f, void *arg);
+static int run_watch(int qfd, int efd, const struct route *r,
+		     const char *statefile);
+static void usage(void);
+
+/* for count_msg() and event_msg() */
+struct watch {
+	const struct route *r;
+	int count;
+	int dirty;
+};
+
+static int addr_len(int family)
+{
+	return family == AF_INET6 ? 16 : 4;
+}
+
+/* an address of the family of the route, which is set by the first one */
+static int parse_addr(struct route *r, const char *s, unsigned char *addr)
+{
+	int family = strchr(s, ':') ? AF_INET6 : AF_INET;
+
+	if (r->family && r->family != family)
+		return -1;
+	if (inet_pton(family, s, addr) != 1)
+		return -1;
+	r->family = family;
+	return 0;
+}
+
+static int parse_prefix(struct route *r, const char *s)
+{
+	char buf[INET6_ADDRSTRLEN + 8];
+	char *c, *end;
+	unsigned long len;
+
+	/* the family may still come from another key or -6 */
+	if (strcmp(s, "default") == 0) {
+		r->dst_len = 0;
+		return 0;
+	}
+	if (strlen(s) >= sizeof(buf))
+		return -1;
+	strcpy(buf, s);
+	c = strchr(buf, '/');
+	if (c)
+		*c++ = 0;
+	if (parse_addr(r, buf, r->dst) < 0)
+		return -1;
+	if (!c) {
+		r->dst_len = addr_len(r->family) * 8;
+		return 0;
+	}
+	len = strtoul(c, &end, 10);
+	if (end == c || *end || len > (unsigned long)addr_len(r->family) * 8)
+		return -1;
+	r->dst_len = len;
+	return 0;
+}
+
+/* "id name" lines, as in /etc/iproute2/rt_tables */
+static int lookup_id(const char *file, const char *name, unsigned long *id)
+{
+	char line[256], word[128];
+	unsigned long n;
+	FILE *f;
+	int found = 0;
+
+	f = fopen(file, "r");
+	if (!f)
+		return 0;
+	while (!found && fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%lu %127s", &n, word) == 2
+		    && strcmp(word, name) == 0) {
+			*id = n;
+			found = 1;
+		}
+	}
+	fclose(f);
+	return found;
+}
+
+static int parse_id(const char *name, const char **files, unsigned long max,
+		    unsigned long *id)
+{
+	char *end;
+
+	*id = strtoul(name, &end, 0);
+	if (end != name && !*end)
+		return *id <= max ? 0 : -1;
+	for (; *files; files++) {
+		if (lookup_id(*files, name, id))
+			return 0;
+	}
+	return -1;
+}
+
+static int parse_route(struct route *r, char **argv)
+{
+	static const char *table_files[] = {
+		"/etc/iproute2/rt_tables", "/usr/share/iproute2/rt_tables", NULL
+	};
+	static const char *proto_files[] = {
+		"/etc/iproute2/rt_protos", "/usr/share/iproute2/rt_protos", NULL
+	};
+	int have_dst = 0;
+	unsigned long id;
+	const char *key;
+
+	for (; *argv; argv++) {
+		key = *argv;
+		if (strcmp(key, "to") != 0 && strcmp(key, "dev") != 0
+		    && strcmp(key, "via") != 0 && strcmp(key, "src") != 0
+		    && strcmp(key, "table") != 0 && strcmp(key, "proto") != 0) {
+			/* the prefix without "to" */
+			key = "to";
+		} else if (!*++argv) {
+			fprintf(stderr, "%s needs an argument\n", key);
+			return -1;
+		}
+
+		if (strcmp(key, "to") == 0) {
+			if (have_dst || parse_prefix(r, *argv) < 0)
+				goto bad;
+			have_dst = 1;
+		} else if (strcmp(key, "dev") == 0) {
+			r->dev = *argv;
+		} else if (strcmp(key, "via") == 0) {
+			if (parse_addr(r, *argv, r->gw) < 0)
+				goto bad;
+			r->has_gw = 1;
+		} else if (strcmp(key, "src") == 0) {
+			if (parse_addr(r, *argv, r->src) < 0)
+				goto bad;
+			r->has_src = 1;
+		} else if (strcmp(key, "table") == 0) {
+			if (strcmp(*argv, "main") == 0)
+				r->table = RT_TABLE_MAIN;
+			else if (strcmp(*argv, "local") == 0)
+				r->table = RT_TABLE_LOCAL;
+			else if (strcmp(*argv, "default") == 0)
+				r->table = RT_TABLE_DEFAULT;
+			else if (strcmp(*argv, "all") == 0)
+				r->table = RTROUTE_TABLE_ALL;
+			else if (parse_id(*argv, table_files, 0xfffffffeUL, &id) < 0
+				 || id == 0)
+				goto bad;
+			else
+				r->table = id;
+		} else {
+			if (strcmp(*argv, "kernel") == 0)
+				r->proto = RTPROT_KERNEL;
+			else if (strcmp(*argv, "boot") == 0)
+				r->proto = RTPROT_BOOT;
+			else if (strcmp(*argv, "static") == 0)
+				r->proto = RTPROT_STATIC;
+			else if (parse_id(*argv, proto_files, 255, &id) < 0)
+				goto bad;
+			else
+				r->proto = id;
+		}
+	}
+	if (!have_dst) {
+		fprintf(stderr, "No destination given\n");
+		return -1;
+	}
+	if (!r->family)
+		r->family = AF_INET;
+	return 0;
+bad:
+	fprintf(stderr, "Bad %s %s\n", key, *argv);
+	return -1;
+}
+
+static void parse_rtattr(struct rtattr **tb, struct nlmsghdr *h)
+{
+	struct rtmsg *rtm = NLMSG_DATA(h);
+	struct rtattr *rta;
+	int len = RTM_PAYLOAD(h);
+
+	memset(tb, 0, sizeof(*tb) * (RTA_MAX + 1));
+	for (rta = RTM_RTA(rtm); RTA_OK(rta, len); rta = RTA_NEXT(rta, len)) {
+		if (rta->rta_type <= RTA_MAX)
+			tb[rta->rta_type] = rta;
+	}
+}
+
+static uint32_t route_table(const struct rtmsg *rtm, struct rtattr **tb)
+{
+	if (tb[RTA_TABLE])
+		return *(uint32_t *)RTA_DATA(tb[RTA_TABLE]);
+	return rtm->rtm_table;
+}
+
+static int attr_equal(struct rtattr *rta, const unsigned char *addr, int alen)
+{
+	return rta && (int)RTA_PAYLOAD(rta) >= alen
+		&& memcmp(RTA_DATA(rta), addr, alen) == 0;
+}
+
+/* as "ip route show to exact" with the other keys as filters */
+static int route_matches(const struct route *r, struct nlmsghdr *h)
+{
+	struct rtmsg *rtm = NLMSG_DATA(h);
+	struct rtattr *tb[RTA_MAX + 1];
+	uint32_t want = r->table ? r->table : RT_TABLE_MAIN;
+	int alen = addr_len(r->family);
+
+	if (h->nlmsg_type != RTM_NEWROUTE && h->nlmsg_type != RTM_DELROUTE)
+		return 0;
+	if (rtm->rtm_family != r->family || rtm->rtm_dst_len != r->dst_len
+	    || (rtm->rtm_flags & RTM_F_CLONED))
+		return 0;
+	if (r->proto >= 0 && rtm->rtm_protocol != r->proto)
+		return 0;
+	parse_rtattr(tb, h);
+	if (want != RTROUTE_TABLE_ALL && route_table(rtm, tb) != want)
+		return 0;
+	if (r->dst_len && !attr_equal(tb[RTA_DST], r->dst, alen))
+		return 0;
+	if (r->oif && (!tb[RTA_OIF]
+		       || *(int *)RTA_DATA(tb[RTA_OIF]) != r->oif))
+		return 0;
+	if (r->has_gw && !attr_equal(tb[RTA_GATEWAY], r->gw, alen))
+		return 0;
+	if (r->has_src && !attr_equal(tb[RTA_PREFSRC], r->src, alen))
+		return 0;
+	return 1;
+}
+
+static void print_route(struct nlmsghdr *h)
+{
+	struct rtmsg *rtm = NLMSG_DATA(h);
+	struct rtattr *tb[RTA_MAX + 1];
+	char addr[INET6_ADDRSTRLEN], name[IF_NAMESIZE];
+
+	parse_rtattr(tb, h);
+	if (rtm->rtm_dst_len && tb[RTA_DST]) {
+		inet_ntop(rtm->rtm_family, RTA_DATA(tb[RTA_DST]), addr, sizeof(addr));
+		printf("%s/%u", addr, rtm->rtm_dst_len);
+	} else {
+		printf("default");
+	}
+	if (tb[RTA_GATEWAY]) {
+		inet_ntop(rtm->rtm_family, RTA_DATA(tb[RTA_GATEWAY]), addr, sizeof(addr));
+		printf(" via %s", addr);
+	}
+	if (tb[RTA_OIF]
+	    && if_indextoname(*(int *)RTA_DATA(tb[RTA_OIF]), name))
+		printf(" dev %s", name);
+	if (tb[RTA_PREFSRC]) {
+		inet_ntop(rtm->rtm_family, RTA_DATA(tb[RTA_PREFSRC]), addr, sizeof(addr));
+		printf(" src %s", addr);
+	}
+	printf(" table %u proto %u", route_table(rtm, tb), rtm->rtm_protocol);
+	if (tb[RTA_PRIORITY])
+		printf(" metric %u", *(uint32_t *)RTA_DATA(tb[RTA_PRIORITY]));
+	printf("\n");
+}
+
+static void show_msg(struct nlmsghdr *h, void *arg)
+{
+	struct watch *w = arg;
+
+	if (route_matches(w->r, h)) {
+		print_route(h);
+		w->count++;
+	}
+}
+
+static void count_msg(struct nlmsghdr *h, void *arg)
+{
+	struct watch *w = arg;
+
+	if (route_matches(w->r, h))
+		w->count++;
+}
+
+static int route_dump(int fd, const struct route *r,
+		      void (*cb)(struct nlmsghdr *h, void *arg), void *arg)
+{
+	static uint32_t seq;
+	struct {
+		struct nlmsghdr nlh;
+		struct rtmsg rtm;
+	} req;
+
+	memset(&req, 0, sizeof(req));
+	req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(req.rtm));
+	req.nlh.nlmsg_type = RTM_GETROUTE;
+	req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+	req.nlh.nlmsg_seq = ++seq;
+	req.rtm.rtm_family = r->family;
+	if (send(fd, &req, req.nlh.nlmsg_len, 0) < 0) {
+		fprintf(stderr, "Failed to send netlink request (%s)\n",
+			strerror(errno));
+		return -1;
+	}
+	return rtnl_read(fd, seq, 1, cb, arg);
+}
+
+static void addattr(struct nlmsghdr *h, int type, const void *data, int len)
+{
+	struct rtattr *rta = (struct rtattr *)(void *)
+		((char *)h + NLMSG_ALIGN(h->nlmsg_len));
+
+	rta->rta_type = type;
+	rta->rta_len = RTA_LENGTH(len);
+	memcpy(RTA_DATA(rta), data, len);
+	h->nlmsg_len = NLMSG_ALIGN(h->nlmsg_len) + RTA_ALIGN(rta->rta_len);
+}
+
+/* the request "ip route add|del" would send */
+static int route_change(int fd, const struct route *r, int del)
+{
+	struct {
+		struct nlmsghdr nlh;
+		struct rtmsg rtm;
+		char attrs[256];
+	} req;
+	char buf[1024];
+	struct nlmsghdr *h;
+	struct nlmsgerr *err;
+	uint32_t table = r->table ? r->table : RT_TABLE_MAIN;
+	int alen = addr_len(r->family);
+	ssize_t len;
+
+	if (table == RTROUTE_TABLE_ALL) {
+		fprintf(stderr, "table all is only for show and watch\n");
+		return -1;
+	}
+	memset(&req, 0, sizeof(req));
+	req.nlh.nlmsg_len = NLMSG_LENGTH(sizeof(req.rtm));
+	req.nlh.nlmsg_type = del ? RTM_DELROUTE : RTM_NEWROUTE;
+	req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ACK
+		| (del ? 0 : NLM_F_CREATE | NLM_F_EXCL);
+	req.nlh.nlmsg_seq = 1;
+	req.rtm.rtm_family = r->family;
+	req.rtm.rtm_dst_len = r->dst_len;
+	if (del) {
+		if (r->family == AF_INET)
+			req.rtm.rtm_scope = RT_SCOPE_NOWHERE;
+	} else {
+		req.rtm.rtm_protocol = r->proto >= 0 ? r->proto : RTPROT_BOOT;
+		req.rtm.rtm_type = RTN_UNICAST;
+		/* a route without a gateway is on link, as with ip */
+		req.rtm.rtm_scope = (r->family == AF_INET && !r->has_gw)
+			? RT_SCOPE_LINK : RT_SCOPE_UNIVERSE;
+	}
+	if (del && r->proto >= 0)
+		req.rtm.rtm_protocol = r->proto;
+	if (table < 256) {
+		req.rtm.rtm_table = table;
+	} else {
+		req.rtm.rtm_table = RT_TABLE_UNSPEC;
+		addattr(&req.nlh, RTA_TABLE, &table, sizeof(table));
+	}
+	if (r->dst_len)
+		addattr(&req.nlh, RTA_DST, r->dst, alen);
+	if (r->oif)
+		addattr(&req.nlh, RTA_OIF, &r->oif, sizeof(r->oif));
+	if (r->has_gw)
+		addattr(&req.nlh, RTA_GATEWAY, r->gw, alen);
+	if (r->has_src)
+		addattr(&req.nlh, RTA_PREFSRC, r->src, alen);
+
+	if (send(fd, &req, req.nlh.nlmsg_len, 0) < 0) {
+		fprintf(stderr, "Failed to send netlink request (%s)\n",
+			strerror(errno));
+		return -1;
+	}
+	for (;;) {
+		len = recv(fd, buf, sizeof(buf), 0);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			fprintf(stderr, "Failed to read rtnetlink (%s)\n",
+				strerror(errno));
+			return -1;
+		}
+		for (h = (struct nlmsghdr *)buf; NLMSG_OK(h, len);
+		     h = NLMSG_NEXT(h, len)) {
+			if (h->nlmsg_type != NLMSG_ERROR || h->nlmsg_seq != 1)
+				continue;
+			err = NLMSG_DATA(h);
+			if (err->error) {
+				fprintf(stderr, "RTNETLINK answers: %s\n",
+					strerror(-err->error));
+				return -1;
+			}
+			return 0;
+		}
+	}
+}
+
+/* a change of any route to the watched prefix calls for a new dump */
+static void event_msg(struct nlmsghdr *h, void *arg)
+{
+	struct watch *w = arg;
+	struct rtmsg *rtm;
+	struct rtattr *tb[RTA_MAX + 1];
+
+	if (!h) {
+		w->dirty = 1;
+		return;
+	}
+	if (h->nlmsg_type != RTM_NEWROUTE && h->nlmsg_type != RTM_DELROUTE)
+		return;
+	rtm = NLMSG_DATA(h);
+	if (rtm->rtm_family != w->r->family || rtm->rtm_dst_len != w->r->dst_len)
+		return;
+	parse_rtattr(tb, h);
+	if (!w->r->dst_len
+	    || attr_equal(tb[RTA_DST], w->r->dst, addr_len(w->r->family)))
+		w->dirty = 1;
+}
+
+/* for write_state() */
+static void print_state(FILE *f, void *arg)
+{
+	fprintf(f, "%s\n", *(int *)arg ? "present" : "missing");
+}
+
+static int run_watch(int qfd, int efd, const struct route *r,
+		     const char *statefile)
+{
+	struct watch w;
+	struct pollfd pfd;
+	int present = -1;
+	char addr[INET6_ADDRSTRLEN];
+
+	inet_ntop(r->family, r->dst, addr, sizeof(addr));
+	memset(&w, 0, sizeof(w));
+	w.r = r;
+	w.dirty = 1;
+	for (;;) {
+		if (w.dirty) {
+			w.dirty = 0;
+			w.count = 0;
+			if (route_dump(qfd, r, count_msg, &w) < 0)
+				return -1;
+			if (present != (w.count > 0)) {
+				present = w.count > 0;
+				syslog(present ? LOG_INFO : LOG_WARNING,
+				       "route to %s/%u is %s", addr, r->dst_len,
+				       present ? "present" : "missing");
+				write_state(statefile, print_state, &present);
+			}
+		}
+		pfd.fd = efd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, -1) < 0 && errno != EINTR)
+			return -1;
+		if (rtnl_read(efd, 0, 0, event_msg, &w) < 0)
+			return -1;
+	}
+}
+
+static void usage(void)
+{
+	printf("Usage: /usr/lib/heartbeat/rtroute {show|add|del} route\n");
+	printf("       /usr/lib/heartbeat/rtroute [ -s statefile ] watch route\n");
+	printf("route: [to] prefix|default [dev nic] [via gateway] [src address]\n");
+	printf("       [table id|name|all] [proto id|name]\n");
+	printf("show exits with 0 if a matching route exists, 1 if not.\n");
+	printf("watch keeps \"present\" or \"missing\" in the state file\n");
+	printf("and runs until killed.\n");
+	exit(RTROUTE_ERROR);
+}
+
+#define OPTION_STRING "46s:h"
+
+int main(int argc, char *argv[])
+{
+	int optchar, cont = 1;
+	const char *statefile = NULL, *cmd;
+	struct route r;
+	struct watch w;
+	int qfd, efd;
+
+	memset(&r, 0, sizeof(r));
+	r.proto = -1;
+
+	while(cont) {
+		optchar = getopt(argc, argv, OPTION_STRING);
+		switch(optchar) {
+		case '4':
+			r.family = AF_INET;
+			break;
+		case '6':
+			r.family = AF_INET6;
+			break;
+		case 's':
+			statefile = optarg;
+			break;
+		case 'h':
+			usage();
+			break;
+		case EOF:
+			cont = 0;
+			break;
+		default:
+			fprintf(stderr, "unknown option, please use '-h' for usage.\n");
+			exit(RTROUTE_ERROR);
+			break;
+		};
+	}
+
+	if (optind + 2 > argc) {
+		usage();
+	}
+	cmd = argv[optind];
+	if (strcmp(cmd, "show") && strcmp(cmd, "add") && strcmp(cmd, "del")
+	    && strcmp(cmd, "watch")) {
+		usage();
+	}
+	if (parse_route(&r, argv + optind + 1) < 0) {
+		exit(RTROUTE_ERROR);
+	}
+	if (r.dev) {
+		r.oif = if_nametoindex(r.dev);
+		if (!r.oif) {
+			fprintf(stderr, "Cannot find device \"%s\"\n", r.dev);
+			exit(RTROUTE_ERROR);
+		}
+	}
+
+	/* subscribe before the first dump, so that no change is missed */
+	efd = -1;
+	if (strcmp(cmd, "watch") == 0) {
+		efd = rtnl_open(r.family == AF_INET6 ? RTMGRP_IPV6_ROUTE
+						     : RTMGRP_IPV4_ROUTE);
+		if (efd < 0) {
+			exit(RTROUTE_ERROR);
+		}
+	}
+	qfd = rtnl_open(0);
+	if (qfd < 0) {
+		exit(RTROUTE_ERROR);
+	}
+
+	if (efd >= 0) {
+		openlog("rtroute", LOG_PID, LOG_DAEMON);
+		run_watch(qfd, efd, &r, statefile);
+		exit(RTROUTE_ERROR);
+	}
+	if (strcmp(cmd, "show") == 0) {
+		memset(&w, 0, sizeof(w));
+		w.r = &r;
+		if (route_dump(qfd, &r, show_msg, &w) < 0) {
+			exit(RTROUTE_ERROR);
+		}
+		exit(w.count ? RTROUTE_OK : RTROUTE_MISSING);
+	}
+	if (route_change(qfd, &r, strcmp(cmd, "del") == 0) < 0) {
+		exit(RTROUTE_ERROR);
+	}
+	close(qfd);
+	return RTROUTE_OK;
+}
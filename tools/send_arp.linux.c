@@ -98,6 +98,8 @@ struct device device = {
 };
 char *source;
 struct in_addr src, dst;
+struct in_addr *dsts;	/* all destinations, dst is the first */
+int ndsts;
 char *target;
 int dad, unsolicited, advert;
 int quiet;
@@ -149,7 +151,8 @@ static char print_usage[]={
 "\n"
 "    device: network interface to use\n"
 "\n"
-"    src_ip_addr: source ip address\n"
+"    src_ip_addr: source ip address, or a comma separated list of them\n"
+"                 to announce them all at once\n"
 "\n"
 "    src_hw_addr: only \"auto\" is supported.\n"
 "                 If other specified, it will exit without sending any ARP packets.\n"
@@ -161,6 +164,14 @@ static char print_usage[]={
 "  Notes: Other options of iputils-arping may be accepted but it's not\n"
 "         intended to be supported in this binary.\n"
 "\n"
+"  usage: send_arp [-fqbD] [-c count] [-w timeout] -I device [-s source] \\\n"
+"              destination...\n"
+"\n"
+"  With more than one destination, every request round goes to all of\n"
+"  them at once, and -w is one deadline for all of them; with -f the\n"
+"  first reply from any of them ends it. With -U or -A and no -s, each\n"
+"  destination is announced as its own source.\n"
+"\n"
 };
 
 void usage(void)
@@ -196,6 +207,17 @@ void usage(void)
 }
 #endif /* hb_mode */
 
+static int is_target(struct in_addr a)
+{
+	int i;
+
+	for (i = 0; i < ndsts; i++) {
+		if (dsts[i].s_addr == a.s_addr)
+			return 1;
+	}
+	return 0;
+}
+
 static void set_signal(int signo, void (*handler)(void))
 {
 	struct sigaction sa;
@@ -414,8 +436,12 @@ static void catcher(void)
 	tv_o.tv_sec = 0;
 
 	if (last.tv_sec==0 || timercmp(&tv_s, &tv_o, >)) {
-		send_pack(s, src, dst,
-			  (struct sockaddr_ll *)&me, (struct sockaddr_ll *)&he);
+		int i;
+
+		/* unsolicited: each address announces itself */
+		for (i = 0; i < ndsts; i++)
+			send_pack(s, (unsolicited && !source) ? dsts[i] : src, dsts[i],
+				  (struct sockaddr_ll *)&me, (struct sockaddr_ll *)&he);
 		if (count == 0 && unsolicited)
 			finish();
 	}
@@ -469,7 +495,7 @@ static int recv_pack(unsigned char *buf, int len, struct sockaddr_ll *FROM)
 	memcpy(&src_ip, p+ah->ar_hln, 4);
 	memcpy(&dst_ip, p+ah->ar_hln+4+ah->ar_hln, 4);
 	if (!dad) {
-		if (src_ip.s_addr != dst.s_addr)
+		if (!is_target(src_ip))
 			return 0;
 		if (src.s_addr != dst_ip.s_addr)
 			return 0;
@@ -489,7 +515,7 @@ static int recv_pack(unsigned char *buf, int len, struct sockaddr_ll *FROM)
 		   also that it matches to dst_ip, otherwise
 		   dst_ip/dst_hw do not matter.
 		 */
-		if (src_ip.s_addr != dst.s_addr)
+		if (!is_target(src_ip))
 			return 0;
 		if (memcmp(p, ((struct sockaddr_ll *)&me)->sll_addr, ((struct sockaddr_ll *)&me)->sll_halen) == 0)
 			return 0;
@@ -1065,6 +1091,9 @@ main(int argc, char **argv)
 	int socket_errno;
 	int ch;
 	int hb_mode = 0;
+	char **targets;
+	char *p;
+	int i;
 
 	signal(SIGTERM, byebye);
 	signal(SIGPIPE, byebye);
@@ -1151,6 +1180,21 @@ main(int argc, char **argv)
 	    unsolicited = 1;
 	    device.name = argv[optind];
 	    target = argv[optind+1];
+	    ndsts = 1;
+	    for (p = target; *p; p++) {
+		if (*p == ',')
+		    ndsts++;
+	    }
+	    targets = calloc(ndsts, sizeof(*targets));
+	    if (!targets) {
+		perror("arping: calloc");
+		exit(2);
+	    }
+	    for (i = 0, p = strtok(target, ","); p && i < ndsts; p = strtok(NULL, ","))
+		targets[i++] = p;
+	    if (i == 0)
+		usage();
+	    ndsts = i;
             if (strcmp(argv[optind+2], "auto")) {
 		fprintf(stderr, "send_arp.linux: Gratuitous ARPs are not sent in the Cluster IP configuration\n");
                 /* return success to suppress an error log by the RA */
@@ -1160,10 +1204,30 @@ main(int argc, char **argv)
 	} else {
 	    argc -= optind;
 	    argv += optind;
-	    if (argc != 1)
+	    if (argc < 1)
 		usage();
 
 	    target = *argv;
+	    targets = argv;
+	    ndsts = argc;
+	}
+
+	/*
+	 * Probe several addresses at once: requests always go out as
+	 * broadcasts, as going unicast to the first to reply would leave
+	 * out the others.
+	 */
+	if (ndsts > 1) {
+		if (unsolicited && source) {
+			fprintf(stderr, "arping: -s takes one address with -U and -A\n");
+			exit(2);
+		}
+		broadcast_only = 1;
+	}
+	dsts = calloc(ndsts, sizeof(*dsts));
+	if (!dsts) {
+		perror("arping: calloc");
+		exit(2);
 	}
 	
 	if (device.name && !*device.name)
@@ -1187,32 +1251,37 @@ main(int argc, char **argv)
 		usage();
 	}
 
-	if (inet_aton(target, &dst) != 1) {
-		struct hostent *hp;
-		char *idn = target;
+	for (i = 0; i < ndsts; i++) {
+		target = targets[i];
+		if (inet_aton(target, &dsts[i]) != 1) {
+			struct hostent *hp;
+			char *idn = target;
 #ifdef USE_IDN
-		int rc;
+			int rc;
 
-		rc = idna_to_ascii_lz(target, &idn, 0);
+			rc = idna_to_ascii_lz(target, &idn, 0);
 
-		if (rc != IDNA_SUCCESS) {
-			fprintf(stderr, "arping: IDN encoding failed: %s\n", idna_strerror(rc));
-			exit(2);
-		}
+			if (rc != IDNA_SUCCESS) {
+				fprintf(stderr, "arping: IDN encoding failed: %s\n", idna_strerror(rc));
+				exit(2);
+			}
 #endif
 
-		hp = gethostbyname2(idn, AF_INET);
-		if (!hp) {
-			fprintf(stderr, "arping: unknown host %s\n", target);
-			exit(2);
-		}
+			hp = gethostbyname2(idn, AF_INET);
+			if (!hp) {
+				fprintf(stderr, "arping: unknown host %s\n", target);
+				exit(2);
+			}
 
 #ifdef USE_IDN
-		free(idn);
+			free(idn);
 #endif
 
-		memcpy(&dst, hp->h_addr, 4);
+			memcpy(&dsts[i], hp->h_addr, 4);
+		}
 	}
+	dst = dsts[0];
+	target = targets[0];
 
 	if (source && inet_aton(source, &src) != 1) {
 		fprintf(stderr, "arping: invalid source %s\n", source);
@@ -0,0 +1,471 @@
+/*
+   Capture the TCP connections of an address for tickle_tcp
+
+   Writes the {local_ip:port remote_ip:port} list that tickle_tcp
+   reads, as the portblock RA used to build from netstat output, but
+   takes it straight from the kernel through sock_diag.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 2 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "conn_diag.h"
+#include "tickle_state.h"
+
+/* exit codes; portblock falls back to netstat on EXIT_NODIAG */
+#define EXIT_NODIAG	2
+
+struct conn_set {
+	struct tickle_state_rec *recs;
+	unsigned long count;
+	unsigned long size;
+};
+
+static int set_add(struct conn_set *set, const struct tickle_state_rec *rec);
+static int capture_cb(const struct sockaddr *local,
+		      const struct sockaddr *remote, void *arg);
+static int rec_cmp(const void *a, const void *b);
+static void set_sort(struct conn_set *set);
+static int parse_addr_port(char *s, uint8_t *family, uint8_t *addr,
+			   uint16_t *port);
+static int read_statefile(const char *path, struct conn_set *set,
+			  int *format);
+static int print_rec(FILE *f, const char *prefix,
+		     const struct tickle_state_rec *rec);
+static int print_set(FILE *f, const struct conn_set *set);
+static unsigned long print_delta(const struct conn_set *old,
+				 const struct conn_set *new);
+static int sync_dir(const char *path);
+static int write_set(FILE *f, const struct conn_set *set, int binary);
+static int write_statefile(const char *path, const struct conn_set *set,
+			   int binary);
+static void usage(void);
+
+static int set_add(struct conn_set *set, const struct tickle_state_rec *rec)
+{
+	struct tickle_state_rec *r;
+
+	if (set->count == set->size) {
+		set->size = set->size ? set->size * 2 : 1024;
+		r = realloc(set->recs, set->size * sizeof(*r));
+		if (!r) {
+			fprintf(stderr, "Failed realloc()\n");
+			return -1;
+		}
+		set->recs = r;
+	}
+	set->recs[set->count++] = *rec;
+	return 0;
+}
+
+static int capture_cb(const struct sockaddr *local,
+		      const struct sockaddr *remote, void *arg)
+{
+	struct tickle_state_rec rec;
+
+	if (tickle_state_rec_set(&rec, local, remote)) {
+		return 0;
+	}
+	return set_add(arg, &rec);
+}
+
+static int rec_cmp(const void *a, const void *b)
+{
+	return memcmp(a, b, sizeof(struct tickle_state_rec));
+}
+
+/* sort and drop duplicates */
+static void set_sort(struct conn_set *set)
+{
+	unsigned long i, n;
+
+	if (set->count == 0)
+		return;
+	qsort(set->recs, set->count, sizeof(*set->recs), rec_cmp);
+	for (i = 1, n = 1; i < set->count; i++) {
+		if (rec_cmp(&set->recs[i], &set->recs[n-1]) != 0)
+			set->recs[n++] = set->recs[i];
+	}
+	set->count = n;
+}
+
+/* parse "ip:port" in place */
+static int parse_addr_port(char *s, uint8_t *family, uint8_t *addr,
+			   uint16_t *port)
+{
+	char *p, *endp;
+	unsigned long n;
+
+	p = strrchr(s, ':');
+	if (!p)
+		return -1;
+	*p++ = 0;
+	n = strtoul(p, &endp, 10);
+	if (endp == p || *endp != 0 || n > 65535)
+		return -1;
+	*port = htons(n);
+
+	if (inet_pton(AF_INET, s, addr) == 1) {
+		*family = TICKLE_STATE_INET;
+	} else if (inet_pton(AF_INET6, s, addr) == 1) {
+		*family = TICKLE_STATE_INET6;
+	} else {
+		return -1;
+	}
+	return 0;
+}
+
+/*
+ * Read a previous snapshot in either format. format is set to 1 for
+ * binary, 0 for text and -1 if there is no file, which is read as
+ * empty.
+ */
+static int read_statefile(const char *path, struct conn_set *set,
+			  int *format)
+{
+	FILE *f;
+	int fd, ret;
+	char line[256], addr1[128], addr2[128];
+	struct tickle_state_rec rec;
+	struct tickle_state_map m;
+	unsigned long i;
+	uint8_t rfamily;
+
+	*format = -1;
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		if (errno == ENOENT)
+			return 0;
+		fprintf(stderr, "Failed to open %s (%s)\n", path, strerror(errno));
+		return -1;
+	}
+
+	ret = tickle_state_map(fd, &m);
+	if (ret != 0) {
+		close(fd);
+		if (ret < 0) {
+			/* replace it with a good one */
+			fprintf(stderr, "Ignoring %s (%s)\n", path, strerror(errno));
+			return 0;
+		}
+		*format = 1;
+		for (i = 0; i < m.count && ret >= 0; i++) {
+			/* copy only what we know of possibly larger records */
+			ret = set_add(set, tickle_state_rec_at(&m, i));
+		}
+		tickle_state_unmap(&m);
+		return ret < 0 ? -1 : 0;
+	}
+
+	*format = 0;
+	f = fdopen(fd, "r");
+	if (!f) {
+		fprintf(stderr, "Failed to read %s (%s)\n", path, strerror(errno));
+		close(fd);
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), f)) {
+		if (sscanf(line, "%127s %127s", addr1, addr2) != 2)
+			continue;
+		memset(&rec, 0, sizeof(rec));
+		if (parse_addr_port(addr1, &rec.family, rec.laddr, &rec.lport)
+		    || parse_addr_port(addr2, &rfamily, rec.raddr, &rec.rport)
+		    || rfamily != rec.family) {
+			continue;
+		}
+		if (set_add(set, &rec)) {
+			fclose(f);
+			return -1;
+		}
+	}
+
+	fclose(f);
+	return 0;
+}
+
+static int print_rec(FILE *f, const char *prefix,
+		     const struct tickle_state_rec *rec)
+{
+	char laddr[INET6_ADDRSTRLEN], raddr[INET6_ADDRSTRLEN];
+	int family;
+
+	family = (rec->family == TICKLE_STATE_INET6) ? AF_INET6 : AF_INET;
+	inet_ntop(family, rec->laddr, laddr, sizeof(laddr));
+	inet_ntop(family, rec->raddr, raddr, sizeof(raddr));
+	return fprintf(f, "%s%s:%u\t%s:%u\n", prefix,
+		       laddr, ntohs(rec->lport), raddr, ntohs(rec->rport));
+}
+
+static int print_set(FILE *f, const struct conn_set *set)
+{
+	unsigned long i;
+
+	for (i = 0; i < set->count; i++) {
+		if (print_rec(f, "", &set->recs[i]) < 0)
+			return -1;
+	}
+	return 0;
+}
+
+/*
+ * Print "+conn" for connections only in new and "-conn" for those
+ * only in old; both sets must be sorted. Returns the number of lines.
+ */
+static unsigned long print_delta(const struct conn_set *old,
+				 const struct conn_set *new)
+{
+	unsigned long i = 0, j = 0, changes = 0;
+	int c;
+
+	while (i < old->count || j < new->count) {
+		if (i == old->count)
+			c = 1;
+		else if (j == new->count)
+			c = -1;
+		else
+			c = rec_cmp(&old->recs[i], &new->recs[j]);
+		if (c < 0) {
+			print_rec(stdout, "-", &old->recs[i++]);
+			changes++;
+		} else if (c > 0) {
+			print_rec(stdout, "+", &new->recs[j++]);
+			changes++;
+		} else {
+			i++;
+			j++;
+		}
+	}
+	return changes;
+}
+
+static int write_set(FILE *f, const struct conn_set *set, int binary)
+{
+	if (binary) {
+		return tickle_state_write(f, set->recs, set->count);
+	}
+	return print_set(f, set);
+}
+
+/* make a rename in the directory of path durable */
+static int sync_dir(const char *path)
+{
+	char *copy, *dir;
+	int fd, ret;
+
+	copy = strdup(path);
+	if (!copy) {
+		fprintf(stderr, "Failed strdup()\n");
+		return -1;
+	}
+	dir = dirname(copy);
+	fd = open(dir, O_RDONLY | O_DIRECTORY);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to open %s (%s)\n", dir, strerror(errno));
+		free(copy);
+		return -1;
+	}
+	ret = fsync(fd);
+	if (ret < 0 && errno != EINVAL) {
+		fprintf(stderr, "Failed to fsync %s (%s)\n", dir, strerror(errno));
+	} else {
+		ret = 0;
+	}
+	close(fd);
+	free(copy);
+	return ret;
+}
+
+/*
+ * Write the snapshot next to path, fsync it and rename it into place,
+ * so that readers (and the sync script) never see a partial file.
+ */
+static int write_statefile(const char *path, const struct conn_set *set,
+			   int binary)
+{
+	char *tmp;
+	int fd;
+	FILE *f;
+
+	tmp = malloc(strlen(path) + sizeof(".XXXXXX"));
+	if (!tmp) {
+		fprintf(stderr, "Failed malloc()\n");
+		return -1;
+	}
+	sprintf(tmp, "%s.XXXXXX", path);
+
+	fd = mkstemp(tmp);
+	if (fd < 0) {
+		fprintf(stderr, "Failed to create %s (%s)\n", tmp, strerror(errno));
+		free(tmp);
+		return -1;
+	}
+	fchmod(fd, 0644);
+
+	f = fdopen(fd, "w");
+	if (!f) {
+		close(fd);
+		goto err;
+	}
+	if (write_set(f, set, binary) < 0 || fflush(f) != 0 || fsync(fd) != 0) {
+		fclose(f);
+		goto err;
+	}
+	if (fclose(f) != 0)
+		goto err;
+
+	if (rename(tmp, path) < 0)
+		goto err;
+
+	free(tmp);
+	return sync_dir(path);
+
+err:
+	fprintf(stderr, "Failed to write %s (%s)\n", path, strerror(errno));
+	unlink(tmp);
+	free(tmp);
+	return -1;
+}
+
+static void usage(void)
+{
+	printf("Usage: /usr/lib/heartbeat/tickle_capture [ -a ] [ -b ] [ -p port[-port] ] [ -f statefile [ -d ] ] ip\n");
+	printf("  -a              all connected sockets, not only the established ones\n");
+	printf("  -b              write the binary statefile format\n");
+	printf("  -p port[-port]  only connections on this local port or port range\n");
+	printf("  -f statefile    replace statefile with the snapshot, instead of\n");
+	printf("                  printing it\n");
+	printf("  -d              print the connections added (+) and removed (-)\n");
+	printf("                  since the previous statefile; statefile is left\n");
+	printf("                  alone if nothing changed\n");
+	printf("Prints {local_ip:port remote_ip:port} lines for the TCP connections\n");
+	printf("of the local address ip, as read by tickle_tcp.\n");
+	exit(1);
+}
+
+#define OPTION_STRING "abdp:f:h"
+
+int main(int argc, char *argv[])
+{
+	int optchar, cont = 1, delta = 0, binary = 0, format;
+	unsigned states = CONN_DIAG_ESTABLISHED;
+	unsigned port_lo = 0, port_hi = 0;
+	const char *statefile = NULL;
+	union {
+		struct sockaddr sa;
+		struct sockaddr_in ip;
+		struct sockaddr_in6 ip6;
+	} local;
+	struct conn_set cur, prev;
+	int ret;
+
+	while(cont) {
+		optchar = getopt(argc, argv, OPTION_STRING);
+		switch(optchar) {
+		case 'a':
+			states = CONN_DIAG_CONNECTED;
+			break;
+		case 'b':
+			binary = 1;
+			break;
+		case 'd':
+			delta = 1;
+			break;
+		case 'p':
+			if (conn_diag_parse_ports(optarg, &port_lo, &port_hi)) {
+				fprintf(stderr, "Bad port %s\n", optarg);
+				exit(EXIT_FAILURE);
+			}
+			break;
+		case 'f':
+			statefile = optarg;
+			break;
+		case 'h':
+			usage();
+			exit(EXIT_SUCCESS);
+			break;
+		case EOF:
+			cont = 0;
+			break;
+		default:
+			fprintf(stderr, "unknown option, please use '-h' for usage.\n");
+			exit(EXIT_FAILURE);
+			break;
+		};
+	}
+
+	if (optind != argc - 1 || (delta && !statefile)) {
+		usage();
+	}
+
+	memset(&local, 0, sizeof(local));
+	if (inet_pton(AF_INET, argv[optind], &local.ip.sin_addr) == 1) {
+		local.ip.sin_family = AF_INET;
+	} else if (inet_pton(AF_INET6, argv[optind], &local.ip6.sin6_addr) == 1) {
+		local.ip6.sin6_family = AF_INET6;
+	} else {
+		fprintf(stderr, "Bad IP address %s\n", argv[optind]);
+		exit(EXIT_FAILURE);
+	}
+
+	memset(&cur, 0, sizeof(cur));
+	memset(&prev, 0, sizeof(prev));
+
+	ret = conn_diag_dump(&local.sa, port_lo, port_hi, states,
+			     capture_cb, &cur);
+	if (ret != 0) {
+		if (errno == EPROTONOSUPPORT) {
+			exit(EXIT_NODIAG);
+		}
+		fprintf(stderr, "Failed to dump connections (%s)\n",
+			strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	set_sort(&cur);
+
+	if (!statefile) {
+		ret = write_set(stdout, &cur, binary);
+	} else if (delta) {
+		if (read_statefile(statefile, &prev, &format)) {
+			exit(EXIT_FAILURE);
+		}
+		set_sort(&prev);
+		ret = 0;
+		if (print_delta(&prev, &cur) > 0 || format != binary) {
+			ret = write_statefile(statefile, &cur, binary);
+		}
+	} else {
+		ret = write_statefile(statefile, &cur, binary);
+	}
+
+	free(cur.recs);
+	free(prev.recs);
+	if (fflush(stdout) != 0) {
+		ret = -1;
+	}
+	return ret ? EXIT_FAILURE : EXIT_SUCCESS;
+}
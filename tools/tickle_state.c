@@ -0,0 +1,189 @@
+/*
+ * Binary tickle state file format.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#include <config.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+
+#include "tickle_state.h"
+
+int tickle_state_map(int fd, struct tickle_state_map *m)
+{
+	struct stat st;
+	struct tickle_state_hdr hdr;
+	size_t rec_size;
+	unsigned long count;
+	void *base;
+
+	memset(m, 0, sizeof(*m));
+
+	if (fstat(fd, &st) < 0) {
+		return -1;
+	}
+	/* pipes and short files can only be text */
+	if (!S_ISREG(st.st_mode) || (size_t)st.st_size < sizeof(hdr)) {
+		return 0;
+	}
+	if (pread(fd, &hdr, sizeof(hdr), 0) != sizeof(hdr)) {
+		return -1;
+	}
+	if (memcmp(hdr.magic, TICKLE_STATE_MAGIC, sizeof(hdr.magic)) != 0) {
+		return 0;
+	}
+
+	rec_size = ntohl(hdr.rec_size);
+	count = ntohl(hdr.count);
+	if (ntohl(hdr.version) != TICKLE_STATE_VERSION
+	    || rec_size < sizeof(struct tickle_state_rec)
+	    || (st.st_size - sizeof(hdr)) / rec_size < count) {
+		fprintf(stderr, "Bad or truncated tickle state file\n");
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (count == 0) {
+		return 1;
+	}
+	base = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (base == MAP_FAILED) {
+		return -1;
+	}
+	madvise(base, st.st_size, MADV_SEQUENTIAL);
+
+	m->base = base;
+	m->len = st.st_size;
+	m->recs = (const unsigned char *)base + sizeof(hdr);
+	m->rec_size = rec_size;
+	m->count = count;
+	return 1;
+}
+
+void tickle_state_unmap(struct tickle_state_map *m)
+{
+	if (m->base) {
+		munmap(m->base, m->len);
+	}
+	memset(m, 0, sizeof(*m));
+}
+
+int tickle_state_write(FILE *f, const struct tickle_state_rec *recs,
+		       unsigned long count)
+{
+	struct tickle_state_hdr hdr;
+
+	if (count > UINT32_MAX) {
+		errno = EFBIG;
+		return -1;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, TICKLE_STATE_MAGIC, sizeof(hdr.magic));
+	hdr.version = htonl(TICKLE_STATE_VERSION);
+	hdr.rec_size = htonl(sizeof(*recs));
+	hdr.count = htonl(count);
+
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1) {
+		return -1;
+	}
+	if (count && fwrite(recs, sizeof(*recs), count, f) != count) {
+		return -1;
+	}
+	return 0;
+}
+
+int tickle_state_rec_set(struct tickle_state_rec *rec,
+			 const struct sockaddr *local,
+			 const struct sockaddr *remote)
+{
+	const struct sockaddr_in *l4 = (const struct sockaddr_in *)local;
+	const struct sockaddr_in *r4 = (const struct sockaddr_in *)remote;
+	const struct sockaddr_in6 *l6 = (const struct sockaddr_in6 *)local;
+	const struct sockaddr_in6 *r6 = (const struct sockaddr_in6 *)remote;
+
+	memset(rec, 0, sizeof(*rec));
+	if (local->sa_family != remote->sa_family) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	switch (local->sa_family) {
+	case AF_INET:
+		rec->family = TICKLE_STATE_INET;
+		rec->lport = l4->sin_port;
+		rec->rport = r4->sin_port;
+		memcpy(rec->laddr, &l4->sin_addr, 4);
+		memcpy(rec->raddr, &r4->sin_addr, 4);
+		break;
+	case AF_INET6:
+		rec->family = TICKLE_STATE_INET6;
+		rec->lport = l6->sin6_port;
+		rec->rport = r6->sin6_port;
+		memcpy(rec->laddr, &l6->sin6_addr, 16);
+		memcpy(rec->raddr, &r6->sin6_addr, 16);
+		break;
+	default:
+		errno = EAFNOSUPPORT;
+		return -1;
+	}
+	return 0;
+}
+
+/* local and remote must have room for a sockaddr_in6 */
+int tickle_state_rec_get(const struct tickle_state_rec *rec,
+			 struct sockaddr *local, struct sockaddr *remote)
+{
+	struct sockaddr_in *l4 = (struct sockaddr_in *)local;
+	struct sockaddr_in *r4 = (struct sockaddr_in *)remote;
+	struct sockaddr_in6 *l6 = (struct sockaddr_in6 *)local;
+	struct sockaddr_in6 *r6 = (struct sockaddr_in6 *)remote;
+
+	switch (rec->family) {
+	case TICKLE_STATE_INET:
+		memset(l4, 0, sizeof(*l4));
+		memset(r4, 0, sizeof(*r4));
+		l4->sin_family = r4->sin_family = AF_INET;
+		l4->sin_port = rec->lport;
+		r4->sin_port = rec->rport;
+		memcpy(&l4->sin_addr, rec->laddr, 4);
+		memcpy(&r4->sin_addr, rec->raddr, 4);
+		break;
+	case TICKLE_STATE_INET6:
+		memset(l6, 0, sizeof(*l6));
+		memset(r6, 0, sizeof(*r6));
+		l6->sin6_family = r6->sin6_family = AF_INET6;
+		l6->sin6_port = rec->lport;
+		r6->sin6_port = rec->rport;
+		memcpy(&l6->sin6_addr, rec->laddr, 16);
+		memcpy(&r6->sin6_addr, rec->raddr, 16);
+		break;
+	default:
+		errno = EAFNOSUPPORT;
+		return -1;
+	}
+	return 0;
+}
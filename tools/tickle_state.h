@@ -0,0 +1,93 @@
+/*
+ * Binary tickle state file format.
+ *
+ * The portblock tickle_dir statefile is either text, one
+ * "local_ip:port remote_ip:port" line per connection, or this format:
+ * a fixed header followed by fixed size records, so that tickle_tcp
+ * can mmap it and walk the records without parsing anything. All
+ * fields are stored in network byte order, as the file is copied
+ * between cluster nodes.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 2
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA
+ * 02110-1301, USA.
+ */
+
+#ifndef TICKLE_STATE_H
+#define TICKLE_STATE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+
+#define TICKLE_STATE_MAGIC	"TICKLEST"
+#define TICKLE_STATE_VERSION	1
+
+/* record families, independent of the AF_ values of the host */
+#define TICKLE_STATE_INET	4
+#define TICKLE_STATE_INET6	6
+
+struct tickle_state_hdr {
+	char magic[8];
+	uint32_t version;
+	uint32_t rec_size;	/* readers step by this, to allow growth */
+	uint32_t count;
+	uint32_t reserved[3];
+};
+
+/*
+ * One connection; unused address bytes and the reserved bytes are
+ * zero, so that records can be sorted and compared with memcmp.
+ */
+struct tickle_state_rec {
+	uint8_t family;
+	uint8_t reserved[3];
+	uint16_t lport;
+	uint16_t rport;
+	uint8_t laddr[16];
+	uint8_t raddr[16];
+};
+
+struct tickle_state_map {
+	void *base;
+	size_t len;
+	const unsigned char *recs;
+	size_t rec_size;
+	unsigned long count;
+};
+
+#define tickle_state_rec_at(m, i) \
+	((const struct tickle_state_rec *)((m)->recs + (i) * (m)->rec_size))
+
+/*
+ * Map the binary statefile open on fd. Returns 1 if it was mapped, 0
+ * if the file is not in the binary format (the caller should read it
+ * as text, from the start) and -1 on errors.
+ */
+int tickle_state_map(int fd, struct tickle_state_map *m);
+void tickle_state_unmap(struct tickle_state_map *m);
+
+/* write the header and count records */
+int tickle_state_write(FILE *f, const struct tickle_state_rec *recs,
+		       unsigned long count);
+
+/* conversion from/to sockaddr_in or sockaddr_in6 pairs */
+int tickle_state_rec_set(struct tickle_state_rec *rec,
+			 const struct sockaddr *local,
+			 const struct sockaddr *remote);
+int tickle_state_rec_get(const struct tickle_state_rec *rec,
+			 struct sockaddr *local, struct sockaddr *remote);
+
+#endif /* TICKLE_STATE_H */
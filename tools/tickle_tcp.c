@@ -19,6 +19,7 @@
    along with this program; if not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <config.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
@@ -32,8 +33,12 @@
 #include <sys/socket.h>
 #include <arpa/inet.h>
 #include <net/if.h>
+#include <time.h>
 
-#define discard_const(ptr) ((void *)((intptr_t)(ptr)))
+#include "tickle_state.h"
+#ifdef HAVE_LINUX_INET_DIAG_H
+#include "conn_diag.h"
+#endif
 
 typedef union {
 	struct sockaddr     sa;
@@ -41,81 +46,241 @@ typedef union {
 	struct sockaddr_in6 ip6;
 } sock_addr;
 
-uint32_t uint16_checksum(uint16_t *data, size_t n);
-void set_nonblocking(int fd);
+struct tickle_pkt4 {
+	struct iphdr ip;
+	struct tcphdr tcp;
+};
+
+struct tickle_pkt6 {
+	struct ip6_hdr ip6;
+	struct tcphdr tcp;
+};
+
+/*
+ * Tickles are queued per address family and handed to the kernel in
+ * batches of up to TICKLE_BATCH packets with sendmmsg(), over one raw
+ * socket per family that is kept open for the life of the process.
+ */
+#define TICKLE_BATCH 64
+
+struct tickle_queue {
+	int family;
+	int sock;
+	unsigned count;
+	union {
+		struct tickle_pkt4 ip4pkt;
+		struct tickle_pkt6 ip6pkt;
+	} pkt[TICKLE_BATCH];
+	sock_addr dst[TICKLE_BATCH];
+	struct iovec iov[TICKLE_BATCH];
+	struct mmsghdr msgs[TICKLE_BATCH];
+};
+
+static struct tickle_queue queue4 = { .family = AF_INET, .sock = -1 };
+static struct tickle_queue queue6 = { .family = AF_INET6, .sock = -1 };
+
+struct tickle_template {
+	union {
+		struct tickle_pkt4 ip4pkt;
+		struct tickle_pkt6 ip6pkt;
+	} pkt;
+	int len;
+	uint64_t sum;
+};
+
+/* indexed by the rst flag */
+static struct tickle_template tmpl4[2];
+static struct tickle_template tmpl6[2];
+static int templates_ready;
+
+static unsigned long tickles_sent;
+static unsigned long tickles_failed;
+
+struct tickle_conn {
+	sock_addr src;
+	sock_addr dst;
+};
+
+/*
+ * The connections to tickle: either parsed from text lines, or the
+ * records of a binary statefile (see tickle_state.h) mapped as is.
+ * With swap set, local and remote are exchanged.
+ */
+struct tickle_input {
+	struct tickle_conn *conns;
+	struct tickle_state_map map;
+	unsigned long count;
+	unsigned long size;
+	int swap;
+};
+
+/*
+ * Token bucket used to keep the overall packet rate below a budget.
+ * A rate of 0 means unlimited.
+ */
+struct token_bucket {
+	double rate;
+	double burst;
+	double tokens;
+	double last;
+};
+
+static uint64_t csum_add(uint64_t sum, const void *buf, size_t len);
+static uint16_t csum_fold(uint64_t sum);
+static void init_templates(void);
 void set_close_on_exec(int fd);
 static int parse_ipv4(const char *s, unsigned port, struct sockaddr_in *sin);
 static int parse_ipv6(const char *s, const char *iface, unsigned port, sock_addr *saddr);
 int parse_ip(const char *addr, const char *iface, unsigned port, sock_addr *saddr);
 int parse_ip_port(const char *addr, sock_addr *saddr);
-int send_tickle_ack(const sock_addr *dst, 
-		    const sock_addr *src, 
-		    uint32_t seq, uint32_t ack, int rst);
+static int open_raw_socket(int family);
+static struct tickle_queue *get_queue(int family);
+static int build_tickle_ack(void *pkt, const sock_addr *dst,
+			    const sock_addr *src,
+			    uint32_t seq, uint32_t ack, int rst);
+static int queue_tickle_ack(const sock_addr *dst,
+			    const sock_addr *src,
+			    uint32_t seq, uint32_t ack, int rst);
+static int flush_tickle_queue(struct tickle_queue *q);
+static int flush_tickle_queues(void);
+static double now_sec(void);
+static void sleep_sec(double secs);
+static void tb_init(struct token_bucket *tb, double rate, double burst);
+static void tb_take(struct token_bucket *tb);
+static int read_connections(FILE *f, struct tickle_conn **conns,
+			    unsigned long *count);
+static int read_input(FILE *f, struct tickle_input *in);
+#ifdef HAVE_LINUX_INET_DIAG_H
+static int capture_cb(const struct sockaddr *local,
+		      const struct sockaddr *remote, void *arg);
+static int capture_input(const char *addr, const char *ports,
+			 struct tickle_input *in);
+#endif
+static void free_input(struct tickle_input *in);
+static int get_connection(const struct tickle_input *in, unsigned long i,
+			  sock_addr *src, sock_addr *dst);
+static void tickle_connections(const struct tickle_input *in, int num,
+			       unsigned interval_ms, unsigned rate);
 static void usage(void);
 
-uint32_t uint16_checksum(uint16_t *data, size_t n)
+/*
+ * Internet checksum (RFC 1071), summed a 64-bit word at a time with
+ * end-around carry. Words are loaded in host order; the one's
+ * complement sum is byte order independent, so the folded result can
+ * be stored as is.
+ */
+static uint64_t csum_add(uint64_t sum, const void *buf, size_t len)
 {
-	uint32_t sum=0;
-	while (n >= 2) {
-		sum += (uint32_t)ntohs(*data);
-		data++;        
-		n -= 2;
-	}                      
-	if (n == 1) {
-		sum += (uint32_t)ntohs(*(uint8_t *)data);
+	const uint8_t *p = buf;
+	uint64_t v;
+	uint32_t w32;
+	union {
+		uint16_t w;
+		uint8_t b[2];
+	} w16;
+
+	while (len >= 8) {
+		memcpy(&v, p, 8);
+		sum += v;
+		if (sum < v)
+			sum++;
+		p += 8;
+		len -= 8;
 	}
-	return sum;
-}       
-
-static uint16_t tcp_checksum(uint16_t *data, size_t n, struct iphdr *ip)
-{
-	uint32_t sum = uint16_checksum(data, n);
-	uint16_t sum2;
-	sum += uint16_checksum((uint16_t *)(void *)&ip->saddr,
-				sizeof(ip->saddr));
-	sum += uint16_checksum((uint16_t *)(void *)&ip->daddr,
-				sizeof(ip->daddr));
-	sum += ip->protocol + n;
-	sum = (sum & 0xFFFF) + (sum >> 16);
-	sum = (sum & 0xFFFF) + (sum >> 16);
-	sum2 = htons(sum);
-	sum2 = ~sum2;
-	if (sum2 == 0) {
-		return 0xFFFF;
+	if (len >= 4) {
+		memcpy(&w32, p, 4);
+		sum += w32;
+		if (sum < w32)
+			sum++;
+		p += 4;
+		len -= 4;
 	}
-	return sum2;
+	if (len >= 2) {
+		memcpy(&w16.w, p, 2);
+		sum += w16.w;
+		if (sum < w16.w)
+			sum++;
+		p += 2;
+		len -= 2;
+	}
+	if (len) {
+		w16.b[0] = *p;
+		w16.b[1] = 0;
+		sum += w16.w;
+		if (sum < w16.w)
+			sum++;
+	}
+	return sum;
 }
 
-static uint16_t tcp_checksum6(uint16_t *data, size_t n, struct ip6_hdr *ip6)
+static uint16_t csum_fold(uint64_t sum)
 {
-	uint32_t phdr[2];
-	uint32_t sum = 0;
-	uint16_t sum2;
-
-	sum += uint16_checksum((uint16_t *)(void *)&ip6->ip6_src, 16);
-	sum += uint16_checksum((uint16_t *)(void *)&ip6->ip6_dst, 16);
-
-	phdr[0] = htonl(n);
-	phdr[1] = htonl(ip6->ip6_nxt);
-	sum += uint16_checksum((uint16_t *)phdr, 8);
-
-	sum += uint16_checksum(data, n);
-
+	sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+	sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+	sum = (sum & 0xFFFF) + (sum >> 16);
 	sum = (sum & 0xFFFF) + (sum >> 16);
 	sum = (sum & 0xFFFF) + (sum >> 16);
-	sum2 = htons(sum);
-	sum2 = ~sum2;
-	if (sum2 == 0) {
+	sum = ~sum & 0xFFFF;
+	if (sum == 0) {
 		return 0xFFFF;
 	}
-	return sum2;
+	return sum;
 }
 
-void set_nonblocking(int fd)
+/*
+ * Per family header templates. Only the addresses, ports, seq and ack
+ * differ between tickles; those are left zero in the template, and
+ * the template keeps the partial checksum over everything else
+ * (including the constant pseudo-header fields). A tickle is then a
+ * copy of the template plus an incremental update of that sum with
+ * the variable fields, as in RFC 1624 with all old values being zero.
+ */
+static void init_templates(void)
 {
-	unsigned v;
-	v = fcntl(fd, F_GETFL, 0);
-	fcntl(fd, F_SETFL, v | O_NONBLOCK);
+	int rst;
+	uint16_t w16[2];
+	uint32_t w32[2];
+	struct tickle_pkt4 *ip4pkt;
+	struct tickle_pkt6 *ip6pkt;
+
+	for (rst = 0; rst < 2; rst++) {
+		ip4pkt = &tmpl4[rst].pkt.ip4pkt;
+		memset(ip4pkt, 0, sizeof(*ip4pkt));
+		ip4pkt->ip.version  = 4;
+		ip4pkt->ip.ihl      = sizeof(ip4pkt->ip)/4;
+		ip4pkt->ip.tot_len  = htons(sizeof(*ip4pkt));
+		ip4pkt->ip.ttl      = 255;
+		ip4pkt->ip.protocol = IPPROTO_TCP;
+		ip4pkt->ip.check    = 0;
+		ip4pkt->tcp.ack     = 1;
+		ip4pkt->tcp.rst     = rst;
+		ip4pkt->tcp.doff    = sizeof(ip4pkt->tcp)/4;
+		ip4pkt->tcp.window  = htons(1234);
+
+		w16[0] = htons(IPPROTO_TCP);
+		w16[1] = htons(sizeof(ip4pkt->tcp));
+		tmpl4[rst].sum = csum_add(csum_add(0, w16, sizeof(w16)),
+					  &ip4pkt->tcp, sizeof(ip4pkt->tcp));
+		tmpl4[rst].len = sizeof(*ip4pkt);
+
+		ip6pkt = &tmpl6[rst].pkt.ip6pkt;
+		memset(ip6pkt, 0, sizeof(*ip6pkt));
+		ip6pkt->ip6.ip6_vfc  = 0x60;
+		ip6pkt->ip6.ip6_plen = htons(20);
+		ip6pkt->ip6.ip6_nxt  = IPPROTO_TCP;
+		ip6pkt->ip6.ip6_hlim = 64;
+		ip6pkt->tcp.ack      = 1;
+		ip6pkt->tcp.rst      = rst;
+		ip6pkt->tcp.doff     = sizeof(ip6pkt->tcp)/4;
+		ip6pkt->tcp.window   = htons(1234);
+
+		w32[0] = htonl(sizeof(ip6pkt->tcp));
+		w32[1] = htonl(IPPROTO_TCP);
+		tmpl6[rst].sum = csum_add(csum_add(0, w32, sizeof(w32)),
+					  &ip6pkt->tcp, sizeof(ip6pkt->tcp));
+		tmpl6[rst].len = sizeof(*ip6pkt);
+	}
+	templates_ready = 1;
 }
 
 void set_close_on_exec(int fd) 
@@ -204,135 +369,445 @@ int parse_ip_port(const char *addr, sock_addr *saddr)
 	return ret;
 }
 
-int send_tickle_ack(const sock_addr *dst, 
-		    const sock_addr *src, 
-		    uint32_t seq, uint32_t ack, int rst)
+static int open_raw_socket(int family)
 {
 	int s;
 	int ret;
 	uint32_t one = 1;
-	uint16_t tmpport;
-	sock_addr *tmpdest;
-	struct {
-		struct iphdr ip;
-		struct tcphdr tcp;
-	} ip4pkt;
-	struct {
-		struct ip6_hdr ip6;
-		struct tcphdr tcp;
-	} ip6pkt;
 
-	switch (src->ip.sin_family) {
-	case AF_INET:
-		memset(&ip4pkt, 0, sizeof(ip4pkt));
-		ip4pkt.ip.version  = 4;
-		ip4pkt.ip.ihl      = sizeof(ip4pkt.ip)/4;
-		ip4pkt.ip.tot_len  = htons(sizeof(ip4pkt));
-		ip4pkt.ip.ttl      = 255;
-		ip4pkt.ip.protocol = IPPROTO_TCP;
-		ip4pkt.ip.saddr    = src->ip.sin_addr.s_addr;
-		ip4pkt.ip.daddr    = dst->ip.sin_addr.s_addr;
-		ip4pkt.ip.check    = 0;
-
-		ip4pkt.tcp.source  = src->ip.sin_port;
-		ip4pkt.tcp.dest    = dst->ip.sin_port;
-		ip4pkt.tcp.seq     = seq;
-		ip4pkt.tcp.ack_seq = ack;
-		ip4pkt.tcp.ack     = 1;
-		if (rst)
-			ip4pkt.tcp.rst = 1;
-		ip4pkt.tcp.doff    = sizeof(ip4pkt.tcp)/4;
-		ip4pkt.tcp.window   = htons(1234);
-		ip4pkt.tcp.check    = tcp_checksum((uint16_t *)&ip4pkt.tcp, sizeof(ip4pkt.tcp), &ip4pkt.ip);
-
-		s = socket(AF_INET, SOCK_RAW, IPPROTO_RAW);
-		if (s == -1) {
-			fprintf(stderr, "Failed to open raw socket (%s)\n", strerror(errno));
-			return -1;
-		}
+	s = socket(family, SOCK_RAW, IPPROTO_RAW);
+	if (s == -1) {
+		fprintf(stderr, "Failed to open raw socket (%s)\n", strerror(errno));
+		return -1;
+	}
 
+	if (family == AF_INET) {
 		ret = setsockopt(s, SOL_IP, IP_HDRINCL, &one, sizeof(one));
 		if (ret != 0) {
 			fprintf(stderr, "Failed to setup IP headers (%s)\n", strerror(errno));
 			close(s);
 			return -1;
 		}
+	}
 
-		set_nonblocking(s);
-		set_close_on_exec(s);
+	set_close_on_exec(s);
+	return s;
+}
 
-		ret = sendto(s, &ip4pkt, sizeof(ip4pkt), 0, 
-			     (const struct sockaddr *)&dst->ip, sizeof(dst->ip));
-		close(s);
-		if (ret != sizeof(ip4pkt)) {
-			fprintf(stderr, "Failed sendto (%s)\n", strerror(errno));
-			return -1;
-		}
+/* the queue of the given family, with its raw socket opened on first use */
+static struct tickle_queue *get_queue(int family)
+{
+	struct tickle_queue *q;
+
+	switch (family) {
+	case AF_INET:
+		q = &queue4;
+		break;
+	case AF_INET6:
+		q = &queue6;
 		break;
+	default:
+		fprintf(stderr, "Not an ipv4/v6 address\n");
+		return NULL;
+	}
 
-        case AF_INET6:
-		memset(&ip6pkt, 0, sizeof(ip6pkt));
-		ip6pkt.ip6.ip6_vfc  = 0x60;
-		ip6pkt.ip6.ip6_plen = htons(20);
-		ip6pkt.ip6.ip6_nxt  = IPPROTO_TCP;
-		ip6pkt.ip6.ip6_hlim = 64;
-		ip6pkt.ip6.ip6_src  = src->ip6.sin6_addr;
-		ip6pkt.ip6.ip6_dst  = dst->ip6.sin6_addr;
-
-		ip6pkt.tcp.source   = src->ip6.sin6_port;
-		ip6pkt.tcp.dest     = dst->ip6.sin6_port;
-		ip6pkt.tcp.seq      = seq;
-		ip6pkt.tcp.ack_seq  = ack;
-		ip6pkt.tcp.ack      = 1;
-		if (rst)
-			ip6pkt.tcp.rst      = 1;
-		ip6pkt.tcp.doff     = sizeof(ip6pkt.tcp)/4;
-		ip6pkt.tcp.window   = htons(1234);
-		ip6pkt.tcp.check    = tcp_checksum6((uint16_t *)&ip6pkt.tcp, sizeof(ip6pkt.tcp), &ip6pkt.ip6);
-
-		s = socket(PF_INET6, SOCK_RAW, IPPROTO_RAW);
-		if (s == -1) {
-			fprintf(stderr, "Failed to open sending socket\n");
-			return -1;
-                }
+	if (q->sock == -1) {
+		q->sock = open_raw_socket(family);
+		if (q->sock == -1) {
+			return NULL;
+		}
+	}
+	return q;
+}
 
-		tmpdest = discard_const(dst);
-		tmpport = tmpdest->ip6.sin6_port;
+/* build the packet into pkt from the template and return its length */
+static int build_tickle_ack(void *pkt, const sock_addr *dst,
+			    const sock_addr *src,
+			    uint32_t seq, uint32_t ack, int rst)
+{
+	struct tickle_pkt4 *ip4pkt = pkt;
+	struct tickle_pkt6 *ip6pkt = pkt;
+	uint64_t sum;
 
-		tmpdest->ip6.sin6_port = 0;
-		ret = sendto(s, &ip6pkt, sizeof(ip6pkt), 0, (const struct sockaddr *)&dst->ip6, sizeof(dst->ip6));
-		tmpdest->ip6.sin6_port = tmpport;
-		close(s);
+	if (!templates_ready) {
+		init_templates();
+	}
+	rst = !!rst;
 
-		if (ret != sizeof(ip6pkt)) {
-			fprintf(stderr, "Failed sendto (%s)\n", strerror(errno));
-			return -1;
-		}
-		break;
+	switch (src->ip.sin_family) {
+	case AF_INET:
+		memcpy(ip4pkt, &tmpl4[rst].pkt.ip4pkt, sizeof(*ip4pkt));
+		ip4pkt->ip.saddr    = src->ip.sin_addr.s_addr;
+		ip4pkt->ip.daddr    = dst->ip.sin_addr.s_addr;
+		ip4pkt->tcp.source  = src->ip.sin_port;
+		ip4pkt->tcp.dest    = dst->ip.sin_port;
+		ip4pkt->tcp.seq     = seq;
+		ip4pkt->tcp.ack_seq = ack;
+
+		/* saddr and daddr are adjacent, so are ports, seq and ack */
+		sum = csum_add(tmpl4[rst].sum, &ip4pkt->ip.saddr, 8);
+		sum = csum_add(sum, &ip4pkt->tcp, 12);
+		ip4pkt->tcp.check   = csum_fold(sum);
+		return tmpl4[rst].len;
+
+	case AF_INET6:
+		memcpy(ip6pkt, &tmpl6[rst].pkt.ip6pkt, sizeof(*ip6pkt));
+		ip6pkt->ip6.ip6_src  = src->ip6.sin6_addr;
+		ip6pkt->ip6.ip6_dst  = dst->ip6.sin6_addr;
+		ip6pkt->tcp.source   = src->ip6.sin6_port;
+		ip6pkt->tcp.dest     = dst->ip6.sin6_port;
+		ip6pkt->tcp.seq      = seq;
+		ip6pkt->tcp.ack_seq  = ack;
+
+		sum = csum_add(tmpl6[rst].sum, &ip6pkt->ip6.ip6_src, 32);
+		sum = csum_add(sum, &ip6pkt->tcp, 12);
+		ip6pkt->tcp.check    = csum_fold(sum);
+		return tmpl6[rst].len;
 
 	default:
 		fprintf(stderr, "Not an ipv4/v6 address\n");
 		return -1;
 	}
+}
+
+/* queue one tickle; returns the number of packets that failed to go
+ * out if the queue had to be flushed to make room */
+static int queue_tickle_ack(const sock_addr *dst,
+			    const sock_addr *src,
+			    uint32_t seq, uint32_t ack, int rst)
+{
+	int failed = 0;
+	int len;
+	unsigned n;
+	struct tickle_queue *q;
+
+	q = get_queue(src->ip.sin_family);
+	if (!q) {
+		tickles_failed++;
+		return 1;
+	}
+	if (q->count == TICKLE_BATCH) {
+		failed = flush_tickle_queue(q);
+	}
+
+	n = q->count;
+	len = build_tickle_ack(&q->pkt[n], dst, src, seq, ack, rst);
+	if (len < 0) {
+		tickles_failed++;
+		return failed + 1;
+	}
+
+	q->dst[n] = *dst;
+	if (q->family == AF_INET6) {
+		q->dst[n].ip6.sin6_port = 0;
+	}
+	q->iov[n].iov_base = &q->pkt[n];
+	q->iov[n].iov_len = len;
+	memset(&q->msgs[n], 0, sizeof(q->msgs[n]));
+	q->msgs[n].msg_hdr.msg_name = &q->dst[n];
+	q->msgs[n].msg_hdr.msg_namelen = (q->family == AF_INET6) ?
+		sizeof(q->dst[n].ip6) : sizeof(q->dst[n].ip);
+	q->msgs[n].msg_hdr.msg_iov = &q->iov[n];
+	q->msgs[n].msg_hdr.msg_iovlen = 1;
+	q->count++;
+
+	return failed;
+}
+
+/* send everything queued; returns the number of packets that failed */
+static int flush_tickle_queue(struct tickle_queue *q)
+{
+	int ret;
+	int failed = 0;
+	unsigned sent = 0;
+
+	while (sent < q->count) {
+#ifdef HAVE_SENDMMSG
+		ret = sendmmsg(q->sock, &q->msgs[sent], q->count - sent, 0);
+#else
+		ret = sendmsg(q->sock, &q->msgs[sent].msg_hdr, 0);
+		if (ret >= 0) {
+			ret = 1;
+		}
+#endif
+		if (ret < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			/* the first remaining packet failed, skip it */
+			fprintf(stderr, "Failed sendmmsg (%s)\n", strerror(errno));
+			failed++;
+			ret = 1;
+		}
+		sent += ret;
+	}
+
+	tickles_sent += q->count - failed;
+	tickles_failed += failed;
+	q->count = 0;
+	return failed;
+}
+
+static int flush_tickle_queues(void)
+{
+	return flush_tickle_queue(&queue4) + flush_tickle_queue(&queue6);
+}
+
+static double now_sec(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void sleep_sec(double secs)
+{
+	struct timespec ts;
+
+	if (secs <= 0) {
+		return;
+	}
+	ts.tv_sec = (time_t)secs;
+	ts.tv_nsec = (long)((secs - ts.tv_sec) * 1e9);
+	while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+		;
+}
+
+static void tb_init(struct token_bucket *tb, double rate, double burst)
+{
+	tb->rate = rate;
+	tb->burst = burst;
+	tb->tokens = burst;
+	tb->last = now_sec();
+}
+
+/* take one token, waiting for it if the bucket is empty */
+static void tb_take(struct token_bucket *tb)
+{
+	double now;
+
+	if (tb->rate <= 0) {
+		return;
+	}
 
+	now = now_sec();
+	tb->tokens += (now - tb->last) * tb->rate;
+	if (tb->tokens > tb->burst) {
+		tb->tokens = tb->burst;
+	}
+	tb->last = now;
+
+	if (tb->tokens < 1) {
+		/* let the already admitted packets go out while we wait */
+		flush_tickle_queues();
+		sleep_sec((1 - tb->tokens) / tb->rate);
+		now = now_sec();
+		tb->tokens += (now - tb->last) * tb->rate;
+		tb->last = now;
+	}
+	tb->tokens -= 1;
+}
+
+/* read all {local_ip:port remote_ip:port} lines; bad lines are skipped */
+static int read_connections(FILE *f, struct tickle_conn **conns,
+			    unsigned long *count)
+{
+	char addrline[128], addr1[64], addr2[64];
+	unsigned long size = 0;
+	struct tickle_conn *c;
+
+	*conns = NULL;
+	*count = 0;
+
+	while(fgets(addrline, sizeof(addrline), f)) {
+		if (sscanf(addrline, "%63s %63s", addr1, addr2) != 2) {
+			continue;
+		}
+
+		if (*count == size) {
+			size = size ? size * 2 : 1024;
+			c = realloc(*conns, size * sizeof(**conns));
+			if (!c) {
+				fprintf(stderr, "Failed realloc()\n");
+				return -1;
+			}
+			*conns = c;
+		}
+		c = &(*conns)[*count];
+
+		if (parse_ip_port(addr1, &c->src)) {
+			fprintf(stderr, "Bad IP:port '%s'\n", addr1);
+			tickles_failed++;
+			continue;
+		}
+		if (parse_ip_port(addr2, &c->dst)) {
+			fprintf(stderr, "Bad IP:port '%s'\n", addr2);
+			tickles_failed++;
+			continue;
+		}
+		(*count)++;
+	}
+	return 0;
+}
+
+/* map a binary statefile, or parse text lines */
+static int read_input(FILE *f, struct tickle_input *in)
+{
+	int ret;
+
+	memset(in, 0, sizeof(*in));
+	ret = tickle_state_map(fileno(f), &in->map);
+	if (ret < 0) {
+		fprintf(stderr, "Failed to map the state file (%s)\n",
+			strerror(errno));
+		return -1;
+	}
+	if (ret > 0) {
+		in->count = in->map.count;
+		return 0;
+	}
+	return read_connections(f, &in->conns, &in->count);
+}
+
+#ifdef HAVE_LINUX_INET_DIAG_H
+static int capture_cb(const struct sockaddr *local,
+		      const struct sockaddr *remote, void *arg)
+{
+	struct tickle_input *in = arg;
+	struct tickle_conn *c;
+
+	if (in->count == in->size) {
+		in->size = in->size ? in->size * 2 : 1024;
+		c = realloc(in->conns, in->size * sizeof(*c));
+		if (!c) {
+			fprintf(stderr, "Failed realloc()\n");
+			return -1;
+		}
+		in->conns = c;
+	}
+	c = &in->conns[in->count++];
+	memset(c, 0, sizeof(*c));
+	memcpy(&c->src, local, local->sa_family == AF_INET ?
+	       sizeof(c->src.ip) : sizeof(c->src.ip6));
+	memcpy(&c->dst, remote, remote->sa_family == AF_INET ?
+	       sizeof(c->dst.ip) : sizeof(c->dst.ip6));
 	return 0;
 }
 
+/* take the established connections of a local address from the kernel */
+static int capture_input(const char *addr, const char *ports,
+			 struct tickle_input *in)
+{
+	sock_addr local;
+	unsigned port_lo = 0, port_hi = 0;
+	int ret;
+
+	memset(in, 0, sizeof(*in));
+	memset(&local, 0, sizeof(local));
+	if (parse_ip(addr, NULL, 0, &local)) {
+		return -1;
+	}
+	if (ports && conn_diag_parse_ports(ports, &port_lo, &port_hi)) {
+		fprintf(stderr, "Bad port range %s\n", ports);
+		return -1;
+	}
+
+	ret = conn_diag_dump(&local.sa, port_lo, port_hi,
+			     CONN_DIAG_ESTABLISHED, capture_cb, in);
+	if (ret == -1) {
+		fprintf(stderr, "Failed to dump connections (%s)\n",
+			strerror(errno));
+	}
+	return ret;
+}
+#endif
+
+static void free_input(struct tickle_input *in)
+{
+	tickle_state_unmap(&in->map);
+	free(in->conns);
+	in->conns = NULL;
+}
+
+static int get_connection(const struct tickle_input *in, unsigned long i,
+			  sock_addr *src, sock_addr *dst)
+{
+	sock_addr *local = in->swap ? dst : src;
+	sock_addr *remote = in->swap ? src : dst;
+
+	if (in->conns) {
+		*local = in->conns[i].src;
+		*remote = in->conns[i].dst;
+		return 0;
+	}
+	return tickle_state_rec_get(tickle_state_rec_at(&in->map, i),
+				    &local->sa, &remote->sa);
+}
+
+/*
+ * Send num tickles to every connection. The repeats go out in rounds
+ * over the whole set; round r starts no earlier than r * interval_ms /
+ * num after the first one, and all packets share one token bucket of
+ * rate packets per second.
+ */
+static void tickle_connections(const struct tickle_input *in, int num,
+			       unsigned interval_ms, unsigned rate)
+{
+	struct token_bucket tb;
+	double start;
+	unsigned long i;
+	int r;
+	sock_addr src, dst;
+
+	tb_init(&tb, rate, rate < TICKLE_BATCH ? 1 : TICKLE_BATCH);
+	start = now_sec();
+
+	for (r = 0; r < num; r++) {
+		if (r > 0 && interval_ms) {
+			flush_tickle_queues();
+			sleep_sec(start + (double)r * interval_ms / 1000 / num
+				  - now_sec());
+		}
+		for (i = 0; i < in->count; i++) {
+			if (get_connection(in, i, &src, &dst)) {
+				tickles_failed++;
+				continue;
+			}
+			tb_take(&tb);
+			queue_tickle_ack(&dst, &src, 0, 0, 0);
+		}
+	}
+	flush_tickle_queues();
+}
+
 static void usage(void)
 {
-	printf("Usage: /usr/lib/heartbeat/tickle_tcp [ -n num ]\n");
-	printf("Please note that this program need to read the list of\n");
-	printf("{local_ip:port remote_ip:port} from stdin.\n");
+	printf("Usage: /usr/lib/heartbeat/tickle_tcp [ -n num ] [ -i interval ] [ -r rate ] [ -l ip [ -p ports ] ] [ -s ] [ -v ]\n");
+	printf("  -n num       send num tickles to each connection (default 1)\n");
+	printf("  -i interval  spread the num tickles over interval milliseconds\n");
+	printf("  -r rate      send at most rate packets per second (default unlimited)\n");
+#ifdef HAVE_LINUX_INET_DIAG_H
+	printf("  -l ip        tickle the established connections of the local address ip,\n");
+	printf("               instead of reading them from stdin\n");
+	printf("  -p ports     with -l, only those on this local port or range (lo-hi)\n");
+#endif
+	printf("  -s           swap the local and remote addresses of each connection\n");
+	printf("  -v           report how many tickles were sent and how many failed\n");
+	printf("Unless -l is given, this program needs to read the list of\n");
+	printf("{local_ip:port remote_ip:port} from stdin, as text lines\n");
+	printf("or as a binary state file written by tickle_capture -b.\n");
 	exit(1);
 }
 
-#define OPTION_STRING "n:h"
+#define OPTION_STRING "n:i:r:l:p:svh"
 
 int main(int argc, char *argv[])
 {
-	int optchar, i, num = 1, cont = 1;
-	sock_addr src, dst;
-	char addrline[128], addr1[64], addr2[64];
+	int optchar, num = 1, cont = 1, verbose = 0, swap = 0;
+	unsigned interval_ms = 0, rate = 0;
+	struct tickle_input in;
+	const char *local = NULL, *ports = NULL;
 
 	while(cont) {
 		optchar = getopt(argc, argv, OPTION_STRING);
@@ -340,6 +815,24 @@ int main(int argc, char *argv[])
 		case 'n':
 			num = atoi(optarg);
 			break;
+		case 'i':
+			interval_ms = strtoul(optarg, NULL, 10);
+			break;
+		case 'r':
+			rate = strtoul(optarg, NULL, 10);
+			break;
+		case 'l':
+			local = optarg;
+			break;
+		case 'p':
+			ports = optarg;
+			break;
+		case 's':
+			swap = 1;
+			break;
+		case 'v':
+			verbose = 1;
+			break;
 		case 'h':
 			usage();
 			exit(EXIT_SUCCESS);
@@ -354,26 +847,26 @@ int main(int argc, char *argv[])
 		};
 	}
 
-	while(fgets(addrline, sizeof(addrline), stdin)) {
-		sscanf(addrline, "%s %s", addr1, addr2);
-
-		if (parse_ip_port(addr1, &src)) {
-			fprintf(stderr, "Bad IP:port '%s'\n", addr1);
+	if (local) {
+#ifdef HAVE_LINUX_INET_DIAG_H
+		if (capture_input(local, ports, &in)) {
 			return -1;
 		}
-		if (parse_ip_port(addr2, &dst)) {
-			fprintf(stderr, "Bad IP:port '%s'\n", addr2);
-			return -1;
-		}
-	
-		for (i = 1; i <= num; i++) {
-			if (send_tickle_ack(&dst, &src, 0, 0, 0)) {
-				fprintf(stderr, "Error while sending tickle ack from '%s' to '%s'\n",
-					addr1, addr2);
-				return -1;
-			}
-		}
+#else
+		fprintf(stderr, "-l is not supported on this platform\n");
+		return -1;
+#endif
+	} else if (read_input(stdin, &in)) {
+		return -1;
+	}
+	in.swap = swap;
 
+	tickle_connections(&in, num, interval_ms, rate);
+
+	if (verbose || tickles_failed) {
+		printf("tickle_tcp: %lu connections, %lu tickles sent, %lu failed\n",
+		       in.count, tickles_sent, tickles_failed);
 	}
-	return 0;
+	free_input(&in);
+	return tickles_failed ? -1 : 0;
 }